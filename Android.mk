@@ -5,7 +5,14 @@ include $(CLEAR_VARS)
 LOCAL_SRC_FILES:=         \
         packagevideo.cpp \
         YuvSource.cpp \
-        AvcSource.cpp
+        AvcSource.cpp \
+        VideoQuality.cpp \
+        QualityMonitor.cpp \
+        SegmentSource.cpp \
+        LatencyTracker.cpp \
+        Mp4Source.cpp \
+        AvcProbe.cpp \
+        CompressedYuvReader.cpp
 
 LOCAL_SHARED_LIBRARIES := \
         libstagefright libmedia liblog libutils libbinder libstagefright_foundation
@@ -17,6 +24,18 @@ LOCAL_C_INCLUDES:= \
 
 LOCAL_CFLAGS += -Wno-multichar -Werror -Wall
 
+# Compressed YUV input, each codec is only supported if its library is in the tree.
+ifneq ($(wildcard external/lz4/lib/lz4.h),)
+LOCAL_C_INCLUDES += external/lz4/lib
+LOCAL_STATIC_LIBRARIES += liblz4
+LOCAL_CFLAGS += -DHAVE_LZ4
+endif
+ifneq ($(wildcard external/zstd/lib/zstd.h),)
+LOCAL_C_INCLUDES += external/zstd/lib
+LOCAL_STATIC_LIBRARIES += libzstd
+LOCAL_CFLAGS += -DHAVE_ZSTD
+endif
+
 LOCAL_MODULE_TAGS := optional
 
 LOCAL_MODULE:= packagevideo
@@ -0,0 +1,257 @@
+#include "AvcProbe.h"
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <media/stagefright/foundation/ABuffer.h>
+#include <media/stagefright/foundation/ADebug.h>
+#include <media/stagefright/MediaErrors.h>
+#include <utils/Timers.h>
+#include <utils/Vector.h>
+
+#include "include/avc_utils.h"
+
+namespace android {
+
+// The read buffer grows until the largest NAL unit fits in it.
+static const size_t kInitialBufferSize = 4 * 1024 * 1024;
+static const size_t kMaxBufferSize = 256 * 1024 * 1024;
+
+static const char* kSliceTypeName[] = {
+    "P", "B", "I", "SP", "SI"
+};
+
+/*
+ * Reads an Exp-Golomb coded value starting at bit *offset of data.
+ *
+ * Returns false if data ends before the value does. Emulation prevention
+ * bytes are not removed, which is fine for the first slice header fields.
+ */
+static bool readUE(const uint8_t* data, size_t size, size_t* offset, uint32_t* value) {
+    size_t numZeroes = 0;
+    for (;;) {
+        if (*offset >= size * 8) {
+            return false;
+        }
+        bool bit = (data[*offset / 8] >> (7 - *offset % 8)) & 1;
+        ++*offset;
+        if (bit) {
+            break;
+        }
+        if (++numZeroes > 31) {
+            return false;
+        }
+    }
+    uint32_t suffix = 0;
+    for (size_t i = 0; i < numZeroes; ++i) {
+        if (*offset >= size * 8) {
+            return false;
+        }
+        suffix = (suffix << 1) | ((data[*offset / 8] >> (7 - *offset % 8)) & 1);
+        ++*offset;
+    }
+    *value = (1u << numZeroes) - 1 + suffix;
+    return true;
+}
+
+static void printJsonString(FILE* out, const char* s) {
+    fputc('"', out);
+    for (; *s != '\0'; ++s) {
+        unsigned char c = *s;
+        if (c == '"' || c == '\\') {
+            fprintf(out, "\\%c", c);
+        } else if (c < 0x20) {
+            fprintf(out, "\\u%04x", c);
+        } else {
+            fputc(c, out);
+        }
+    }
+    fputc('"', out);
+}
+
+status_t probeAvcFile(const char* filename, float frameRate, FILE* out) {
+    if (frameRate <= 0) {
+        fprintf(stderr, "invalid frame rate %f\n", frameRate);
+        return BAD_VALUE;
+    }
+    FILE* file = fopen(filename, "rb");
+    if (file == NULL) {
+        fprintf(stderr, "couldn't open %s\n", filename);
+        return NAME_NOT_FOUND;
+    }
+    int64_t start = systemTime();
+
+    size_t capacity = kInitialBufferSize;
+    uint8_t* buffer = (uint8_t*)malloc(capacity);
+    if (buffer == NULL) {
+        fprintf(stderr, "couldn't allocate %zu bytes\n", capacity);
+        fclose(file);
+        return NO_MEMORY;
+    }
+    const uint8_t* data = buffer;
+    size_t size = 0;
+    bool eof = false;
+    status_t err = OK;
+
+    int64_t nalTypeCounts[32] = {0};
+    int64_t sliceTypeCounts[5] = {0};
+    int64_t numNalUnits = 0, numBytes = 0;
+    int64_t numPictures = 0, numSlices = 0;
+    int64_t pictureSlices = 0, maxSlicesPerPicture = 0;
+    int32_t spsProfile = -1, spsLevel = -1, spsWidth = 0, spsHeight = 0;
+    Vector<int64_t> idrPictures;
+    Vector<int64_t> bytesPerSecond;
+
+    const uint8_t* nalStart;
+    size_t nalSize;
+    for (;;) {
+        // Same parser as AvcSource, the last NAL unit ends at the end of file.
+        if (getNextNALUnit(&data, &size, &nalStart, &nalSize, eof) != OK) {
+            if (eof) {
+                break;
+            }
+            if (size > 0) {
+                memmove(buffer, data, size);
+            }
+            if (size == capacity) {
+                // a single NAL unit fills the buffer
+                if (capacity >= kMaxBufferSize) {
+                    fprintf(stderr, "NAL unit larger than %zu bytes\n", kMaxBufferSize);
+                    err = ERROR_MALFORMED;
+                    break;
+                }
+                uint8_t* larger = (uint8_t*)realloc(buffer, capacity * 2);
+                if (larger == NULL) {
+                    fprintf(stderr, "couldn't allocate %zu bytes\n", capacity * 2);
+                    err = NO_MEMORY;
+                    break;
+                }
+                buffer = larger;
+                capacity *= 2;
+            }
+            data = buffer;
+            size_t n = fread(buffer + size, 1, capacity - size, file);
+            eof = n == 0;
+            size += n;
+            continue;
+        }
+        if (nalSize == 0) {
+            continue;
+        }
+        uint8_t nalType = nalStart[0] & 0x1F;
+        ++nalTypeCounts[nalType];
+        ++numNalUnits;
+        numBytes += nalSize + 4;
+
+        if (nalType == 1 || nalType == 5) {
+            // first_mb_in_slice is 0, coded as a single 1 bit, on the first
+            // slice of every picture
+            if (nalSize > 1 && (nalStart[1] & 0x80)) {
+                if (numPictures > 0 && pictureSlices > maxSlicesPerPicture) {
+                    maxSlicesPerPicture = pictureSlices;
+                }
+                pictureSlices = 0;
+                if (nalType == 5) {
+                    idrPictures.push(numPictures);
+                }
+                ++numPictures;
+            }
+            ++numSlices;
+            ++pictureSlices;
+
+            size_t offset = 8;
+            uint32_t firstMb, sliceType;
+            if (readUE(nalStart, nalSize, &offset, &firstMb)
+                    && readUE(nalStart, nalSize, &offset, &sliceType)) {
+                ++sliceTypeCounts[sliceType % 5];
+            }
+        } else if (nalType == 7 && spsProfile < 0 && nalSize > 3) {
+            spsProfile = nalStart[1];
+            spsLevel = nalStart[3];
+            sp<ABuffer> sps = new ABuffer((void*)nalStart, nalSize);
+            FindAVCDimensions(sps, &spsWidth, &spsHeight);
+        }
+
+        // NAL units before the first slice of a picture count for that picture
+        int64_t picture = (nalType == 1 || nalType == 5) && numPictures > 0
+                ? numPictures - 1 : numPictures;
+        size_t second = (size_t)(picture / frameRate);
+        while (bytesPerSecond.size() <= second) {
+            bytesPerSecond.push(0);
+        }
+        bytesPerSecond.editItemAt(second) += nalSize + 4;
+    }
+    free(buffer);
+    fclose(file);
+    if (err != OK) {
+        return err;
+    }
+    if (pictureSlices > maxSlicesPerPicture) {
+        maxSlicesPerPicture = pictureSlices;
+    }
+    int64_t elapsedUs = (systemTime() - start) / 1000;
+
+    fprintf(out, "{\n  \"file\": ");
+    printJsonString(out, filename);
+    fprintf(out, ",\n  \"bytes\": %" PRId64 ",\n", numBytes);
+    fprintf(out, "  \"nal_units\": %" PRId64 ",\n  \"nal_types\": {", numNalUnits);
+    const char* separator = "";
+    for (int i = 0; i < 32; ++i) {
+        if (nalTypeCounts[i] > 0) {
+            fprintf(out, "%s\"%d\": %" PRId64, separator, i, nalTypeCounts[i]);
+            separator = ", ";
+        }
+    }
+    fprintf(out, "},\n");
+    fprintf(out, "  \"sps\": {\"profile\": %d, \"level\": %d, \"width\": %d, \"height\": %d},\n",
+            spsProfile, spsLevel, spsWidth, spsHeight);
+
+    fprintf(out, "  \"pictures\": %" PRId64 ",\n  \"slices\": %" PRId64 ",\n",
+            numPictures, numSlices);
+    fprintf(out, "  \"slices_per_picture\": {\"avg\": %.2f, \"max\": %" PRId64 "},\n",
+            numPictures > 0 ? (double)numSlices / numPictures : 0.0, maxSlicesPerPicture);
+    fprintf(out, "  \"slice_types\": {");
+    separator = "";
+    for (int i = 0; i < 5; ++i) {
+        if (sliceTypeCounts[i] > 0) {
+            fprintf(out, "%s\"%s\": %" PRId64, separator, kSliceTypeName[i], sliceTypeCounts[i]);
+            separator = ", ";
+        }
+    }
+    fprintf(out, "},\n");
+
+    fprintf(out, "  \"idr_pictures\": [");
+    for (size_t i = 0; i < idrPictures.size(); ++i) {
+        fprintf(out, "%s%" PRId64, i > 0 ? ", " : "", idrPictures[i]);
+    }
+    fprintf(out, "],\n");
+
+    // a GOP runs from an IDR picture to the next one or to the end
+    int64_t minGop = 0, maxGop = 0;
+    for (size_t i = 0; i < idrPictures.size(); ++i) {
+        int64_t end = i + 1 < idrPictures.size() ? idrPictures[i + 1] : numPictures;
+        int64_t gop = end - idrPictures[i];
+        if (i == 0 || gop < minGop) minGop = gop;
+        if (gop > maxGop) maxGop = gop;
+    }
+    fprintf(out, "  \"gop\": {\"count\": %zu, \"min\": %" PRId64 ", \"max\": %" PRId64
+            ", \"avg\": %.2f},\n", idrPictures.size(), minGop, maxGop,
+            idrPictures.isEmpty() ? 0.0
+                    : (double)(numPictures - idrPictures[0]) / idrPictures.size());
+
+    fprintf(out, "  \"frame_rate\": %.3f,\n  \"duration\": %.3f,\n",
+            frameRate, numPictures / frameRate);
+    fprintf(out, "  \"bit_rate\": %" PRId64 ",\n",
+            numPictures > 0 ? (int64_t)(numBytes * 8 * frameRate / numPictures) : 0);
+    fprintf(out, "  \"bit_rate_per_second\": [");
+    for (size_t i = 0; i < bytesPerSecond.size(); ++i) {
+        fprintf(out, "%s%" PRId64, i > 0 ? ", " : "", bytesPerSecond[i] * 8);
+    }
+    fprintf(out, "],\n");
+    fprintf(out, "  \"elapsed_us\": %" PRId64 "\n}\n", elapsedUs);
+
+    return OK;
+}
+
+}  // namespace android
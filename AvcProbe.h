@@ -0,0 +1,22 @@
+#ifndef AVC_PROBE_H_
+
+#define AVC_PROBE_H_
+
+#include <stdio.h>
+
+#include <utils/Errors.h>
+
+namespace android {
+
+// Scans the Annex-B AVC stream in filename in a single pass, without copying
+// the NAL units nor writing any output, and prints a JSON report to out:
+// NAL unit type counts, SPS profile/level/resolution, picture and slice
+// counts, IDR picture positions, GOP lengths and the bit rate of every
+// second of the stream. Pictures are timed at frameRate.
+// Fails if frameRate is not positive or if a NAL unit is too large for the
+// read buffer to grow to.
+status_t probeAvcFile(const char* filename, float frameRate, FILE* out);
+
+}  // namespace android
+
+#endif // AVC_PROBE_H_
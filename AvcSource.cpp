@@ -1,11 +1,13 @@
 #include "AvcSource.h"
+
+#include <inttypes.h>
 
 #include <media/stagefright/MediaBufferGroup.h>
 #include <media/stagefright/foundation/ADebug.h>
 #include <media/stagefright/MediaDefs.h>
 #include <media/stagefright/MetaData.h>
 
-extern int32_t gNumFramesOutput;
+extern int64_t gNumFramesOutput;
 namespace android {
 
 const uint8_t startCode[] = {0,0,0,1};
@@ -44,9 +46,9 @@ status_t getNextNALUnit(
     size_t startOffset = offset;
 
     for (;;) {
-        while (offset < size && data[offset] != 0x01) {
-            ++offset;
-        }
+        // memchr is much faster than a byte loop on large slices
+        const uint8_t *next = (const uint8_t *)memchr(&data[offset], 0x01, size - offset);
+        offset = next != NULL ? next - data : size;
 
         if (offset == size) {
             if (startCodeFollows) {
@@ -83,7 +85,7 @@ status_t getNextNALUnit(
     return OK;
 }
 
-AvcSource::AvcSource(int width, int height, int nFrames, int fps, int colorFormat, const char* filename)
+AvcSource::AvcSource(int width, int height, int64_t nFrames, int fps, int colorFormat, const char* filename)
     : mWidth(width),
       mHeight(height),
       mMaxNumFrames(nFrames),
@@ -92,7 +94,13 @@ AvcSource::AvcSource(int width, int height, int nFrames, int fps, int colorForma
       mSize(width * height),
       mSawSpsPpsFrame(false),
       mSpsFrame(NULL), 
-      mPpsFrame(NULL) {
+      mPpsFrame(NULL),
+      mGopFrames(0),
+      mPictureIndex(-1),
+      mPicturesInGop(-1),
+      mKeepPicture(false),
+      mPendingNal(NULL),
+      mPendingNalSize(0) {
 
     mGroup.add_buffer(new MediaBuffer(width * height));
     if (filename != NULL) {
@@ -126,6 +134,10 @@ status_t AvcSource::start(MetaData *params __unused) {
     mSawSpsPpsFrame = false;
     mSpsFrame = NULL;
     mPpsFrame = NULL;
+    mPictureIndex = -1;
+    mPicturesInGop = -1;
+    mKeepPicture = false;
+    mPendingNal = NULL;
     return OK;
 }
 
@@ -144,8 +156,10 @@ status_t AvcSource::read(
     if (mNumFramesOutput % 10 == 0) {
         fprintf(stderr, ".");
     }
-    if (mNumFramesOutput == mMaxNumFrames) {
-        printf("mMaxNumFrames: %d\n", mMaxNumFrames);
+    // when trimming GOPs the limit counts input pictures, not kept ones
+    int64_t numFrames = mGopFrames > 0 ? mPictureIndex + 1 : mNumFramesOutput;
+    if (mMaxNumFrames > 0 && numFrames >= mMaxNumFrames) {
+        printf("mMaxNumFrames: %" PRId64 "\n", mMaxNumFrames);
         return ERROR_END_OF_STREAM;
     }
 
@@ -158,7 +172,11 @@ status_t AvcSource::read(
     while(true) {
         const uint8_t *nalStart;
         size_t nalSize;
-        if (getNALUnit(&nalStart, &nalSize) != OK) {
+        if (mPendingNal != NULL) {
+            nalStart = mPendingNal;
+            nalSize = mPendingNalSize;
+            mPendingNal = NULL;
+        } else if (getNALUnit(&nalStart, &nalSize) != OK) {
             printf("end of stream\n");
             (*buffer)->release();
             *buffer = NULL;
@@ -197,6 +215,15 @@ status_t AvcSource::read(
 //                printf("SPS PPS Frame\n");
                 break;
             }
+        } else if (mGopFrames > 0) {
+            err = readPicture(*buffer, nalStart, nalSize);
+            if (err != OK) {
+                (*buffer)->release();
+                *buffer = NULL;
+                return err;
+            }
+            ++mNumFramesOutput;
+            break;
         } else {
             uint8_t * data = (uint8_t *)(*buffer)->data();
             memcpy(data, startCode, START_CODE_BYTES);
@@ -217,6 +244,76 @@ status_t AvcSource::read(
     return OK;
 }
 
+void AvcSource::setGopFrames(int numFrames) {
+    mGopFrames = numFrames;
+}
+
+/*
+ * Copies the slices of the next picture kept by setGopFrames() into buffer
+ * as one access unit, starting at the given NAL unit. The first slice of
+ * the following picture is left in mPendingNal for the next call.
+ */
+status_t AvcSource::readPicture(MediaBuffer *buffer, const uint8_t *nalStart, size_t nalSize)
+{
+    uint8_t *data = (uint8_t *)buffer->data();
+    size_t size = 0;
+    bool isSync = false;
+    int64_t pictureIndex = 0;
+
+    for (;;) {
+        uint8_t nalType = nalStart[0] & 0x1F;
+        if (nalType == 1 || nalType == 5) {
+            // first_mb_in_slice is 0 on the first slice of a picture
+            if (nalSize > 1 && (nalStart[1] & 0x80)) {
+                if (size > 0) {
+                    mPendingNal = nalStart;
+                    mPendingNalSize = nalSize;
+                    break;
+                }
+                if (mMaxNumFrames > 0 && mPictureIndex + 1 >= mMaxNumFrames) {
+                    printf("mMaxNumFrames: %" PRId64 "\n", mMaxNumFrames);
+                    return ERROR_END_OF_STREAM;
+                }
+                ++mPictureIndex;
+                if (nalType == 5) {
+                    mPicturesInGop = 0;
+                } else if (mPicturesInGop >= 0) {
+                    ++mPicturesInGop;
+                }
+                mKeepPicture = mPicturesInGop >= 0 && mPicturesInGop < mGopFrames;
+                isSync = nalType == 5;
+                pictureIndex = mPictureIndex;
+            }
+            if (mKeepPicture) {
+                if (size + START_CODE_BYTES + nalSize > buffer->size()) {
+                    fprintf(stderr, "picture %" PRId64 " larger than %zu bytes\n",
+                            mPictureIndex, buffer->size());
+                    return ERROR_MALFORMED;
+                }
+                memcpy(data + size, startCode, START_CODE_BYTES);
+                memcpy(data + size + START_CODE_BYTES, nalStart, nalSize);
+                size += START_CODE_BYTES + nalSize;
+            }
+        }
+        // other NAL units and the slices of dropped pictures are skipped
+
+        if (getNALUnit(&nalStart, &nalSize) != OK) {
+            if (size > 0) {
+                break;
+            }
+            printf("end of stream\n");
+            return ERROR_END_OF_STREAM;
+        }
+    }
+
+    buffer->set_range(0, size);
+    buffer->meta_data()->clear();
+    buffer->meta_data()->setInt32(kKeyIsSyncFrame, isSync);
+    buffer->meta_data()->setInt64(kKeyTime, (pictureIndex * 1000000) / mFrameRate);
+    buffer->meta_data()->setInt64(kKeyDecodingTime, (pictureIndex * 1000000) / mFrameRate);
+    return OK;
+}
+
 status_t AvcSource::getNALUnit(const uint8_t **nalStart, size_t *nalSize)
 {
     while (getNextNALUnit(&mNalData, &mNalSize, nalStart, nalSize, false) != OK) {
@@ -11,13 +11,20 @@ namespace android {
 class AvcSource : public MediaSource {
 
 public:
-    AvcSource(int width, int height, int nFrames, int fps, int colorFormat, const char* filename);
+    AvcSource(int width, int height, int64_t nFrames, int fps, int colorFormat, const char* filename);
 
     virtual sp<MetaData> getFormat();
     virtual status_t start(MetaData *params __unused);
     virtual status_t stop();
     virtual status_t read(MediaBuffer **buffer, const MediaSource::ReadOptions *options __unused);
     status_t getNALUnit(const uint8_t **nalStart, size_t *nalSize);
+    // Keeps only the first numFrames pictures of every GOP, starting at the
+    // first IDR picture, e.g. 1 for IDR frames only. The slices of a kept
+    // picture are output together as one access unit, with the timestamp of
+    // its position in the input. Everything else is skipped without being
+    // copied. The nFrames limit then counts input pictures, kept or not.
+    // 0 (default) keeps all.
+    void setGopFrames(int numFrames);
 
 protected:
     virtual ~AvcSource();
@@ -25,7 +32,7 @@ protected:
 private:
     MediaBufferGroup mGroup;
     int mWidth, mHeight;
-    int mMaxNumFrames;
+    int64_t mMaxNumFrames;
     int mFrameRate;
     int mColorFormat;
     int64_t mNumFramesOutput;
@@ -39,6 +46,15 @@ private:
     size_t mSpsFrameSize;
     uint8_t* mPpsFrame;
     size_t mPpsFrameSize;
+    int mGopFrames;
+    int64_t mPictureIndex;
+    int mPicturesInGop;
+    bool mKeepPicture;
+    // first slice of the next picture, read while completing the last one
+    const uint8_t* mPendingNal;
+    size_t mPendingNalSize;
+
+    status_t readPicture(MediaBuffer *buffer, const uint8_t *nalStart, size_t nalSize);
 
     AvcSource(const AvcSource &);
     AvcSource &operator=(const AvcSource &);
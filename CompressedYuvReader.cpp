@@ -0,0 +1,313 @@
+#include "CompressedYuvReader.h"
+
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <media/stagefright/foundation/ADebug.h>
+#include <media/stagefright/foundation/ByteUtils.h>
+#include <media/stagefright/MediaErrors.h>
+
+#ifdef HAVE_LZ4
+#include <lz4.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace android {
+
+static const char kMagic[] = "YUVZ";
+static const size_t kHeaderSize = 24;
+// how long a worker waits for the encoder to return a buffer
+static const nsecs_t kBufferPollNs = 2000000ll;
+
+// static
+bool CompressedYuvReader::isCompressed(const char* filename) {
+    char magic[4];
+    FILE* file = fopen(filename, "rb");
+    if (file == NULL) {
+        return false;
+    }
+    bool compressed = fread(magic, 1, sizeof(magic), file) == sizeof(magic)
+            && !memcmp(magic, kMagic, sizeof(magic));
+    fclose(file);
+    return compressed;
+}
+
+CompressedYuvReader::CompressedYuvReader(const char* filename)
+    : mInitCheck(NO_INIT),
+      mFd(-1),
+      mCodec(0),
+      mWidth(0),
+      mHeight(0),
+      mFrameSize(0),
+      mNumFrames(0),
+      mMaxCompressedSize(0),
+      mNumBuffers(0),
+      mStopping(false),
+      mError(OK),
+      mFrameLimit(0),
+      mNextFrame(0),
+      mReadFrame(0) {
+
+    // Errors are only reported by start(), a reader may be opened just to
+    // look at the header.
+    mFd = open(filename, O_RDONLY | O_LARGEFILE);
+    struct stat64 st;
+    if (mFd < 0 || fstat64(mFd, &st) != 0) {
+        return;
+    }
+    posix_fadvise64(mFd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    uint8_t header[kHeaderSize];
+    if (pread64(mFd, header, kHeaderSize, 0) != (ssize_t)kHeaderSize
+            || memcmp(header, kMagic, 4) || U16LE_AT(header + 4) != 1) {
+        mInitCheck = ERROR_MALFORMED;
+        return;
+    }
+    mCodec = U16LE_AT(header + 6);
+    mWidth = U32LE_AT(header + 8);
+    mHeight = U32LE_AT(header + 12);
+    mFrameSize = U32LE_AT(header + 16);
+    mNumFrames = U32LE_AT(header + 20);
+
+    bool supported = false;
+#ifdef HAVE_LZ4
+    supported |= mCodec == kCodecLZ4;
+#endif
+#ifdef HAVE_ZSTD
+    supported |= mCodec == kCodecZstd;
+#endif
+    if (!supported) {
+        mInitCheck = ERROR_UNSUPPORTED;
+        return;
+    }
+
+    // the offset table must fit in the file, computed in 64 bits so that
+    // a bogus frame count can not wrap around
+    uint64_t tableBytes = ((uint64_t)mNumFrames + 1) * sizeof(uint64_t);
+    if (kHeaderSize + tableBytes > (uint64_t)st.st_size) {
+        mInitCheck = ERROR_MALFORMED;
+        return;
+    }
+    size_t tableSize = tableBytes;
+    uint8_t* table = new uint8_t[tableSize];
+    bool ok = pread64(mFd, table, tableSize, kHeaderSize) == (ssize_t)tableSize;
+    for (int64_t i = 0; ok && i <= mNumFrames; ++i) {
+        mOffsets.push(U64LE_AT(table + i * sizeof(uint64_t)));
+        if (i > 0) {
+            // a frame may not shrink past the offset table nor grow much
+            // past its uncompressed size
+            uint64_t size = mOffsets[i] - mOffsets[i - 1];
+            ok = mOffsets[i] >= mOffsets[i - 1] && mOffsets[i - 1] >= kHeaderSize + tableSize
+                    && size <= (uint64_t)mFrameSize + mFrameSize / 8 + 1024;
+            if (ok && size > mMaxCompressedSize) {
+                mMaxCompressedSize = size;
+            }
+        }
+    }
+    delete[] table;
+    if (!ok || mFrameSize == 0) {
+        mInitCheck = ERROR_MALFORMED;
+        return;
+    }
+    mInitCheck = OK;
+}
+
+CompressedYuvReader::~CompressedYuvReader() {
+    stop();
+    if (mFd >= 0) {
+        close(mFd);
+    }
+}
+
+status_t CompressedYuvReader::initCheck() const {
+    return mInitCheck;
+}
+
+status_t CompressedYuvReader::start(int numThreads, int64_t maxFrames) {
+    if (mInitCheck != OK) {
+        if (mInitCheck == ERROR_UNSUPPORTED) {
+            fprintf(stderr, "unsupported YUV compression %d\n", mCodec);
+        } else if (mInitCheck == ERROR_MALFORMED) {
+            fprintf(stderr, "malformed compressed YUV file\n");
+        } else {
+            fprintf(stderr, "couldn't open compressed YUV file\n");
+        }
+        return mInitCheck;
+    }
+    stop();
+
+    if (numThreads <= 0) {
+        numThreads = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if (numThreads < 1) {
+        numThreads = 1;
+    } else if (numThreads > kMaxThreads) {
+        numThreads = kMaxThreads;
+    }
+    // Every worker holds a buffer while decompressing, two more let the
+    // encoder hold one while the next one is waiting in the queue.
+    for (; mNumBuffers < numThreads + 2; ++mNumBuffers) {
+        mGroup.add_buffer(new MediaBuffer(mFrameSize));
+    }
+
+    mStopping = false;
+    mError = OK;
+    mFrameLimit = maxFrames > 0 && maxFrames < mNumFrames ? maxFrames : mNumFrames;
+    mNextFrame = 0;
+    mReadFrame = 0;
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
+    for (int i = 0; i < numThreads; ++i) {
+        pthread_t thread;
+        if (pthread_create(&thread, &attr, ThreadWrapper, this) != 0) {
+            break;
+        }
+        mThreads.push(thread);
+    }
+    pthread_attr_destroy(&attr);
+    if (mThreads.isEmpty()) {
+        return UNKNOWN_ERROR;
+    }
+    return OK;
+}
+
+void CompressedYuvReader::stop() {
+    {
+        Mutex::Autolock autoLock(mLock);
+        mStopping = true;
+        mCondition.broadcast();
+    }
+    for (size_t i = 0; i < mThreads.size(); ++i) {
+        pthread_join(mThreads[i], NULL);
+    }
+    mThreads.clear();
+
+    for (size_t i = 0; i < mDecodedFrames.size(); ++i) {
+        mDecodedFrames.valueAt(i)->release();
+    }
+    mDecodedFrames.clear();
+}
+
+status_t CompressedYuvReader::read(MediaBuffer **buffer) {
+    *buffer = NULL;
+    Mutex::Autolock autoLock(mLock);
+    for (;;) {
+        if (mReadFrame >= mFrameLimit || mStopping) {
+            return ERROR_END_OF_STREAM;
+        }
+        ssize_t index = mDecodedFrames.indexOfKey(mReadFrame);
+        if (index >= 0) {
+            *buffer = mDecodedFrames.valueAt(index);
+            mDecodedFrames.removeItemsAt(index);
+            ++mReadFrame;
+            return OK;
+        }
+        if (mError != OK) {
+            return mError;
+        }
+        mCondition.wait(mLock);
+    }
+}
+
+// static
+void *CompressedYuvReader::ThreadWrapper(void *me) {
+    static_cast<CompressedYuvReader *>(me)->threadFunc();
+    return NULL;
+}
+
+/*
+ * Waits for a free buffer, giving up when the reader is stopped. The group
+ * is polled since a blocking acquire could not be interrupted by stop().
+ */
+bool CompressedYuvReader::acquireBuffer(MediaBuffer **buffer) {
+    for (;;) {
+        status_t err = mGroup.acquire_buffer(buffer, true /* nonBlocking */);
+        if (err == OK) {
+            return true;
+        }
+        Mutex::Autolock autoLock(mLock);
+        if (mStopping || mNextFrame >= mFrameLimit) {
+            return false;
+        }
+        if (err != WOULD_BLOCK) {
+            mError = err;
+            mCondition.broadcast();
+            return false;
+        }
+        mCondition.waitRelative(mLock, kBufferPollNs);
+    }
+}
+
+void CompressedYuvReader::threadFunc() {
+    uint8_t* compressed = new uint8_t[mMaxCompressedSize];
+#ifdef HAVE_ZSTD
+    ZSTD_DCtx* zstd = mCodec == kCodecZstd ? ZSTD_createDCtx() : NULL;
+#endif
+
+    for (;;) {
+        // Take the buffer before the frame number, so that a claimed frame
+        // never waits for a buffer held by a later frame.
+        MediaBuffer* buffer;
+        if (!acquireBuffer(&buffer)) {
+            break;
+        }
+
+        int64_t frame;
+        {
+            Mutex::Autolock autoLock(mLock);
+            if (mStopping || mError != OK || mNextFrame >= mFrameLimit) {
+                buffer->release();
+                break;
+            }
+            frame = mNextFrame++;
+        }
+
+        size_t size = mOffsets[frame + 1] - mOffsets[frame];
+        size_t decodedSize = 0;
+        if (pread64(mFd, compressed, size, mOffsets[frame]) == (ssize_t)size) {
+#ifdef HAVE_LZ4
+            if (mCodec == kCodecLZ4) {
+                int n = LZ4_decompress_safe((const char*)compressed, (char*)buffer->data(),
+                        size, mFrameSize);
+                decodedSize = n > 0 ? n : 0;
+            }
+#endif
+#ifdef HAVE_ZSTD
+            if (mCodec == kCodecZstd && zstd != NULL) {
+                size_t n = ZSTD_decompressDCtx(zstd, buffer->data(), mFrameSize,
+                        compressed, size);
+                decodedSize = ZSTD_isError(n) ? 0 : n;
+            }
+#endif
+        }
+
+        Mutex::Autolock autoLock(mLock);
+        if (decodedSize != mFrameSize) {
+            fprintf(stderr, "couldn't decompress frame %" PRId64 "\n", frame);
+            buffer->release();
+            mError = ERROR_MALFORMED;
+            mCondition.broadcast();
+            break;
+        }
+        buffer->set_range(0, mFrameSize);
+        mDecodedFrames.add(frame, buffer);
+        mCondition.broadcast();
+    }
+
+#ifdef HAVE_ZSTD
+    if (zstd != NULL) {
+        ZSTD_freeDCtx(zstd);
+    }
+#endif
+    delete[] compressed;
+}
+
+}  // namespace android
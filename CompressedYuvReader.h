@@ -0,0 +1,97 @@
+#ifndef COMPRESSED_YUV_READER_H_
+
+#define COMPRESSED_YUV_READER_H_
+
+#include <pthread.h>
+
+#include <media/stagefright/MediaBuffer.h>
+#include <media/stagefright/MediaBufferGroup.h>
+#include <utils/Condition.h>
+#include <utils/KeyedVector.h>
+#include <utils/Mutex.h>
+#include <utils/RefBase.h>
+#include <utils/Vector.h>
+
+namespace android {
+
+// Reads a YUV file whose frames are compressed one by one, and decompresses
+// them on a pool of worker threads straight into the MediaBuffers returned
+// by read(), in frame order.
+//
+// File layout, little endian:
+//   0  "YUVZ"
+//   4  uint16 version, 1
+//   6  uint16 codec, 1 = LZ4 block, 2 = Zstandard frame
+//   8  uint32 width
+//  12  uint32 height
+//  16  uint32 uncompressed bytes per frame
+//  20  uint32 number of frames N
+//  24  uint64 offsets[N + 1], file offset of every compressed frame and of
+//      the end of the last one
+class CompressedYuvReader : public RefBase {
+
+public:
+    enum {
+        kCodecLZ4 = 1,
+        kCodecZstd = 2,
+    };
+
+    // True if filename starts with the header above.
+    static bool isCompressed(const char* filename);
+
+    explicit CompressedYuvReader(const char* filename);
+
+    status_t initCheck() const;
+    int getWidth() const { return mWidth; }
+    int getHeight() const { return mHeight; }
+    size_t getFrameSize() const { return mFrameSize; }
+    int64_t getNumFrames() const { return mNumFrames; }
+
+    // Starts numThreads workers (0 means one per CPU) decompressing the
+    // first maxFrames frames (0 means all).
+    status_t start(int numThreads, int64_t maxFrames);
+    // Returns the next frame, ERROR_END_OF_STREAM after the last one.
+    status_t read(MediaBuffer **buffer);
+    void stop();
+
+protected:
+    virtual ~CompressedYuvReader();
+
+private:
+    enum {
+        kMaxThreads = 8,
+    };
+
+    status_t mInitCheck;
+    int mFd;
+    int mCodec;
+    int mWidth, mHeight;
+    size_t mFrameSize;
+    int64_t mNumFrames;
+    Vector<uint64_t> mOffsets;
+    size_t mMaxCompressedSize;
+
+    MediaBufferGroup mGroup;
+    int mNumBuffers;
+    Vector<pthread_t> mThreads;
+
+    Mutex mLock;
+    Condition mCondition;
+    bool mStopping;
+    status_t mError;
+    int64_t mFrameLimit;
+    int64_t mNextFrame;     // next frame claimed by a worker
+    int64_t mReadFrame;     // next frame returned by read()
+    KeyedVector<int64_t, MediaBuffer *> mDecodedFrames;
+
+    static void *ThreadWrapper(void *me);
+    void threadFunc();
+    bool acquireBuffer(MediaBuffer **buffer);
+
+    CompressedYuvReader(const CompressedYuvReader &);
+    CompressedYuvReader &operator=(const CompressedYuvReader &);
+};
+
+}  // namespace android
+
+#endif // COMPRESSED_YUV_READER_H_
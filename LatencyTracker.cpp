@@ -0,0 +1,72 @@
+#include "LatencyTracker.h"
+
+#include <inttypes.h>
+#include <string.h>
+
+namespace android {
+
+// Frames captured this long before the one being muxed were dropped by the
+// encoder and will never reach the writer.
+static const int64_t kMaxPendingUs = 1000000ll;
+
+LatencyTracker::LatencyTracker()
+    : mNumFrames(0),
+      mMaxLatencyUs(0) {
+    memset(mHistogram, 0, sizeof(mHistogram));
+}
+
+void LatencyTracker::onCaptured(int64_t timeUs) {
+    Mutex::Autolock autoLock(mLock);
+    mCaptureTimes.add(timeUs, systemTime(SYSTEM_TIME_MONOTONIC));
+}
+
+void LatencyTracker::onMuxed(int64_t timeUs) {
+    nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+
+    Mutex::Autolock autoLock(mLock);
+    ssize_t index = mCaptureTimes.indexOfKey(timeUs);
+    if (index >= 0) {
+        int64_t latencyUs = (now - mCaptureTimes.valueAt(index)) / 1000;
+        mCaptureTimes.removeItemsAt(index);
+
+        int64_t bucket = latencyUs / kBucketUs;
+        ++mHistogram[bucket < kNumBuckets ? bucket : kNumBuckets - 1];
+        ++mNumFrames;
+        if (latencyUs > mMaxLatencyUs) {
+            mMaxLatencyUs = latencyUs;
+        }
+    }
+
+    // the keys are sorted, oldest first
+    while (!mCaptureTimes.isEmpty() && mCaptureTimes.keyAt(0) < timeUs - kMaxPendingUs) {
+        mCaptureTimes.removeItemsAt(0);
+    }
+}
+
+int64_t LatencyTracker::percentileUs(int percent) const {
+    int64_t rank = (mNumFrames * percent + 99) / 100;
+    int64_t count = 0;
+    for (int i = 0; i < kNumBuckets; ++i) {
+        count += mHistogram[i];
+        if (count >= rank) {
+            // upper bound of the bucket
+            int64_t latencyUs = (i + 1) * (int64_t)kBucketUs;
+            return i < kNumBuckets - 1 && latencyUs < mMaxLatencyUs ? latencyUs : mMaxLatencyUs;
+        }
+    }
+    return mMaxLatencyUs;
+}
+
+void LatencyTracker::dumpStats(FILE* out) {
+    Mutex::Autolock autoLock(mLock);
+    if (mNumFrames == 0) {
+        fprintf(out, "latency: no frames measured\n");
+        return;
+    }
+    fprintf(out, "latency: capture to mux over %" PRId64 " frames: "
+            "p50 %.1f ms, p90 %.1f ms, p99 %.1f ms, max %.1f ms\n",
+            mNumFrames, percentileUs(50) / 1000.0, percentileUs(90) / 1000.0,
+            percentileUs(99) / 1000.0, mMaxLatencyUs / 1000.0);
+}
+
+}  // namespace android
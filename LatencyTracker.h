@@ -0,0 +1,48 @@
+#ifndef LATENCY_TRACKER_H_
+
+#define LATENCY_TRACKER_H_
+
+#include <stdio.h>
+
+#include <utils/KeyedVector.h>
+#include <utils/Mutex.h>
+#include <utils/RefBase.h>
+#include <utils/Timers.h>
+
+namespace android {
+
+// Measures the time each frame spends between its capture by the source and
+// its arrival at the writer. Frames are identified by their timestamp.
+// Latencies are kept in a fixed size histogram, so memory does not grow
+// with the length of the recording.
+class LatencyTracker : public RefBase {
+
+public:
+    LatencyTracker();
+
+    void onCaptured(int64_t timeUs);
+    void onMuxed(int64_t timeUs);
+    void dumpStats(FILE* out);
+
+private:
+    // 100 us buckets up to 1 s, the last one counts everything above
+    enum {
+        kBucketUs = 100,
+        kNumBuckets = 10001,
+    };
+
+    Mutex mLock;
+    KeyedVector<int64_t, nsecs_t> mCaptureTimes;
+    uint32_t mHistogram[kNumBuckets];
+    int64_t mNumFrames;
+    int64_t mMaxLatencyUs;
+
+    int64_t percentileUs(int percent) const;
+
+    LatencyTracker(const LatencyTracker &);
+    LatencyTracker &operator=(const LatencyTracker &);
+};
+
+}  // namespace android
+
+#endif // LATENCY_TRACKER_H_
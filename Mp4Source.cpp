@@ -0,0 +1,512 @@
+#include "Mp4Source.h"
+
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <media/stagefright/foundation/ADebug.h>
+#include <media/stagefright/foundation/ByteUtils.h>
+#include <media/stagefright/MediaBuffer.h>
+#include <media/stagefright/MediaDefs.h>
+#include <media/stagefright/MediaErrors.h>
+#include <media/stagefright/MetaData.h>
+
+extern int64_t gNumFramesOutput;
+namespace android {
+
+#ifndef FOURCC
+#define FOURCC(c1, c2, c3, c4) \
+    ((uint32_t)(c1) << 24 | (uint32_t)(c2) << 16 | (uint32_t)(c3) << 8 | (uint32_t)(c4))
+#endif
+
+static const uint8_t kStartCode[] = {0,0,0,1};
+static const size_t kMaxMoovSize = 64 * 1024 * 1024;
+
+// Size of a VisualSampleEntry up to its child boxes, header included.
+static const size_t kVisualSampleEntrySize = 86;
+
+/*
+ * Iterates over the boxes in [*data, *data + *size), returning the type and
+ * the payload of the next one.
+ *
+ * Returns false at the end or on a truncated box.
+ */
+static bool nextBox(const uint8_t** data, size_t* size, uint32_t* type,
+        const uint8_t** payload, size_t* payloadSize) {
+    if (*size < 8) {
+        return false;
+    }
+    uint64_t boxSize = U32_AT(*data);
+    size_t headerSize = 8;
+    *type = U32_AT(*data + 4);
+    if (boxSize == 1) {
+        if (*size < 16) {
+            return false;
+        }
+        boxSize = U64_AT(*data + 8);
+        headerSize = 16;
+    } else if (boxSize == 0) {
+        boxSize = *size;
+    }
+    if (boxSize < headerSize || boxSize > *size) {
+        return false;
+    }
+
+    *payload = *data + headerSize;
+    *payloadSize = boxSize - headerSize;
+    *data += boxSize;
+    *size -= boxSize;
+    return true;
+}
+
+static bool findBox(const uint8_t* data, size_t size, uint32_t wanted,
+        const uint8_t** payload, size_t* payloadSize) {
+    uint32_t type;
+    while (nextBox(&data, &size, &type, payload, payloadSize)) {
+        if (type == wanted) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * Finds a full box (version and flags) holding a table of entryBytes sized
+ * entries preceded by headerBytes of fields and an entry count.
+ *
+ * Returns the entries and their count, or false if missing or truncated.
+ */
+static bool findTable(const uint8_t* data, size_t size, uint32_t type,
+        size_t headerBytes, size_t entryBytes,
+        const uint8_t** entries, uint32_t* numEntries, uint8_t* version = NULL) {
+    const uint8_t* box;
+    size_t boxSize;
+    if (!findBox(data, size, type, &box, &boxSize) || boxSize < 8 + headerBytes) {
+        return false;
+    }
+    if (version != NULL) {
+        *version = box[0];
+    }
+    *numEntries = U32_AT(box + 4 + headerBytes);
+    *entries = box + 8 + headerBytes;
+    return (uint64_t)*numEntries * entryBytes <= boxSize - 8 - headerBytes;
+}
+
+Mp4Source::Mp4Source(int64_t nFrames, const char* filename)
+    : mInitCheck(NO_INIT),
+      mFd(-1),
+      mMaxNumFrames(nFrames),
+      mTimeLimitUs(0),
+      mNumFramesOutput(0),
+      mMoov(NULL),
+      mWidth(0),
+      mHeight(0),
+      mTimeScale(0),
+      mDuration(0),
+      mAvcC(NULL),
+      mAvcCSize(0),
+      mLengthSize(4),
+      mTotalSampleSize(0),
+      mNumSamples(0),
+      mConstantSampleSize(0),
+      mSampleSizes(NULL),
+      mMaxSampleSize(0),
+      mNumChunks(0),
+      mChunkOffsets(NULL),
+      mChunkOffsets64(false),
+      mNumSampleToChunk(0),
+      mSampleToChunk(NULL),
+      mNumTimeToSample(0),
+      mTimeToSample(NULL),
+      mNumCompositionOffsets(0),
+      mCompositionOffsets(NULL),
+      mCompositionOffsetsSigned(false),
+      mNumSyncSamples(0),
+      mSyncSamples(NULL),
+      mSampleData(NULL) {
+
+    if (filename == NULL) {
+        return;
+    }
+    mFd = open(filename, O_RDONLY | O_LARGEFILE);
+    if (mFd < 0) {
+        fprintf(stderr, "couldn't open %s\n", filename);
+        return;
+    }
+    struct stat64 st;
+    if (fstat64(mFd, &st) != 0) {
+        return;
+    }
+    // The samples are read in file order, let the kernel read ahead.
+    posix_fadvise64(mFd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    // find the top level moov box
+    off64_t offset = 0;
+    uint8_t header[16];
+    while (offset + 8 <= st.st_size && pread64(mFd, header, 8, offset) == 8) {
+        uint64_t boxSize = U32_AT(header);
+        uint32_t type = U32_AT(header + 4);
+        size_t headerSize = 8;
+        if (boxSize == 1) {
+            if (pread64(mFd, header + 8, 8, offset + 8) != 8) {
+                break;
+            }
+            boxSize = U64_AT(header + 8);
+            headerSize = 16;
+        } else if (boxSize == 0) {
+            boxSize = st.st_size - offset;
+        }
+        if (boxSize < headerSize) {
+            break;
+        }
+
+        if (type == FOURCC('m', 'o', 'o', 'v')) {
+            size_t moovSize = boxSize - headerSize;
+            if (moovSize > kMaxMoovSize) {
+                fprintf(stderr, "moov box too large: %" PRIu64 "\n", boxSize);
+                return;
+            }
+            mMoov = new uint8_t[moovSize];
+            if (pread64(mFd, mMoov, moovSize, offset + headerSize) != (ssize_t)moovSize) {
+                return;
+            }
+            mInitCheck = parseMoov(mMoov, moovSize);
+            break;
+        }
+        offset += boxSize;
+    }
+    if (mInitCheck != OK) {
+        fprintf(stderr, "no AVC video track found in %s\n", filename);
+        return;
+    }
+
+    // Annex-B output grows when NAL lengths are shorter than a start code.
+    size_t bufferSize = mMaxSampleSize;
+    if (mLengthSize < 4) {
+        bufferSize *= 3;
+        mSampleData = new uint8_t[mMaxSampleSize];
+    }
+    mGroup.add_buffer(new MediaBuffer(bufferSize));
+}
+
+Mp4Source::~Mp4Source() {
+    delete[] mSampleData;
+    delete[] mAvcC;
+    delete[] mMoov;
+    if (mFd >= 0) {
+        close(mFd);
+    }
+}
+
+status_t Mp4Source::initCheck() const {
+    return mInitCheck;
+}
+
+int64_t Mp4Source::toUs(int64_t time) const {
+    return time * 1000000ll / mTimeScale;
+}
+
+int64_t Mp4Source::getDurationUs() const {
+    return mTimeScale > 0 ? toUs(mDuration) : 0;
+}
+
+int32_t Mp4Source::getBitRate() const {
+    int64_t durationUs = getDurationUs();
+    return durationUs > 0 ? mTotalSampleSize * 8000000ll / durationUs : 0;
+}
+
+void Mp4Source::setTimeLimitUs(int64_t timeLimitUs) {
+    mTimeLimitUs = timeLimitUs;
+}
+
+status_t Mp4Source::parseMoov(const uint8_t* data, size_t size) {
+    uint32_t type;
+    const uint8_t* trak;
+    size_t trakSize;
+    while (nextBox(&data, &size, &type, &trak, &trakSize)) {
+        if (type == FOURCC('t', 'r', 'a', 'k') && parseTrack(trak, trakSize) == OK) {
+            return OK;
+        }
+    }
+    return ERROR_UNSUPPORTED;
+}
+
+status_t Mp4Source::parseTrack(const uint8_t* data, size_t size) {
+    const uint8_t *mdia, *hdlr, *mdhd, *minf, *stbl, *stsd;
+    size_t mdiaSize, hdlrSize, mdhdSize, minfSize, stblSize, stsdSize;
+    if (!findBox(data, size, FOURCC('m', 'd', 'i', 'a'), &mdia, &mdiaSize)
+            || !findBox(mdia, mdiaSize, FOURCC('h', 'd', 'l', 'r'), &hdlr, &hdlrSize)
+            || hdlrSize < 12 || U32_AT(hdlr + 8) != FOURCC('v', 'i', 'd', 'e')) {
+        return ERROR_UNSUPPORTED;
+    }
+
+    if (!findBox(mdia, mdiaSize, FOURCC('m', 'd', 'h', 'd'), &mdhd, &mdhdSize)) {
+        return ERROR_MALFORMED;
+    }
+    if (mdhd[0] == 1 && mdhdSize >= 32) {
+        mTimeScale = U32_AT(mdhd + 20);
+        mDuration = U64_AT(mdhd + 24);
+    } else if (mdhd[0] == 0 && mdhdSize >= 20) {
+        mTimeScale = U32_AT(mdhd + 12);
+        mDuration = U32_AT(mdhd + 16);
+    } else {
+        return ERROR_MALFORMED;
+    }
+    if (mTimeScale == 0) {
+        return ERROR_MALFORMED;
+    }
+
+    if (!findBox(mdia, mdiaSize, FOURCC('m', 'i', 'n', 'f'), &minf, &minfSize)
+            || !findBox(minf, minfSize, FOURCC('s', 't', 'b', 'l'), &stbl, &stblSize)
+            || !findBox(stbl, stblSize, FOURCC('s', 't', 's', 'd'), &stsd, &stsdSize)
+            || stsdSize < 8 + kVisualSampleEntrySize) {
+        return ERROR_MALFORMED;
+    }
+
+    // only the first sample description is used
+    const uint8_t* entry = stsd + 8;
+    size_t entrySize = U32_AT(entry);
+    uint32_t entryType = U32_AT(entry + 4);
+    if (entryType != FOURCC('a', 'v', 'c', '1') && entryType != FOURCC('a', 'v', 'c', '3')) {
+        return ERROR_UNSUPPORTED;
+    }
+    if (entrySize < kVisualSampleEntrySize || entrySize > stsdSize - 8) {
+        return ERROR_MALFORMED;
+    }
+    mWidth = U16_AT(entry + 32);
+    mHeight = U16_AT(entry + 34);
+
+    const uint8_t* avcC;
+    size_t avcCSize;
+    if (!findBox(entry + kVisualSampleEntrySize, entrySize - kVisualSampleEntrySize,
+            FOURCC('a', 'v', 'c', 'C'), &avcC, &avcCSize) || avcCSize < 7) {
+        return ERROR_MALFORMED;
+    }
+    mLengthSize = (avcC[4] & 3) + 1;
+    if (mLengthSize == 3) {
+        return ERROR_MALFORMED;
+    }
+    mAvcC = new uint8_t[avcCSize];
+    memcpy(mAvcC, avcC, avcCSize);
+    mAvcCSize = avcCSize;
+
+    return parseSampleTables(stbl, stblSize);
+}
+
+status_t Mp4Source::parseSampleTables(const uint8_t* stbl, size_t size) {
+    const uint8_t* stsz;
+    size_t stszSize;
+    if (!findBox(stbl, size, FOURCC('s', 't', 's', 'z'), &stsz, &stszSize) || stszSize < 12) {
+        // stz2 compact sample sizes are not supported
+        return ERROR_UNSUPPORTED;
+    }
+    mConstantSampleSize = U32_AT(stsz + 4);
+    mNumSamples = U32_AT(stsz + 8);
+    mSampleSizes = stsz + 12;
+    if (mConstantSampleSize == 0 && (uint64_t)mNumSamples * 4 > stszSize - 12) {
+        return ERROR_MALFORMED;
+    }
+    for (uint32_t i = 0; i < mNumSamples; ++i) {
+        size_t sampleSize = mConstantSampleSize ? mConstantSampleSize : U32_AT(mSampleSizes + 4 * i);
+        if (sampleSize > mMaxSampleSize) {
+            mMaxSampleSize = sampleSize;
+        }
+        mTotalSampleSize += sampleSize;
+    }
+
+    if (findTable(stbl, size, FOURCC('c', 'o', '6', '4'), 0, 8, &mChunkOffsets, &mNumChunks)) {
+        mChunkOffsets64 = true;
+    } else if (!findTable(stbl, size, FOURCC('s', 't', 'c', 'o'), 0, 4, &mChunkOffsets, &mNumChunks)) {
+        return ERROR_MALFORMED;
+    }
+    if (!findTable(stbl, size, FOURCC('s', 't', 's', 'c'), 0, 12,
+                &mSampleToChunk, &mNumSampleToChunk)
+            || !findTable(stbl, size, FOURCC('s', 't', 't', 's'), 0, 8,
+                &mTimeToSample, &mNumTimeToSample)
+            || mNumSampleToChunk == 0 || mNumTimeToSample == 0 || mNumChunks == 0) {
+        return ERROR_MALFORMED;
+    }
+
+    uint8_t cttsVersion = 0;
+    if (findTable(stbl, size, FOURCC('c', 't', 't', 's'), 0, 8,
+            &mCompositionOffsets, &mNumCompositionOffsets, &cttsVersion)) {
+        mCompositionOffsetsSigned = cttsVersion == 1;
+    } else {
+        mNumCompositionOffsets = 0;
+    }
+    if (!findTable(stbl, size, FOURCC('s', 't', 's', 's'), 0, 4,
+            &mSyncSamples, &mNumSyncSamples)) {
+        mSyncSamples = NULL;
+        mNumSyncSamples = 0;
+    }
+    return OK;
+}
+
+sp<MetaData> Mp4Source::getFormat() {
+    sp<MetaData> meta = new MetaData;
+    meta->setInt32(kKeyWidth, mWidth);
+    meta->setInt32(kKeyHeight, mHeight);
+    meta->setCString(kKeyMIMEType, MEDIA_MIMETYPE_VIDEO_AVC);
+    meta->setData(kKeyAVCC, kTypeAVCC, mAvcC, mAvcCSize);
+    meta->setInt64(kKeyDuration, getDurationUs());
+
+    return meta;
+}
+
+status_t Mp4Source::start(MetaData *params __unused) {
+    if (mInitCheck != OK) {
+        return mInitCheck;
+    }
+    mNumFramesOutput = 0;
+    gNumFramesOutput = 0;
+
+    mSampleIndex = 0;
+    mChunkIndex = 0;
+    mSampleInChunk = 0;
+    mSampleToChunkIndex = 0;
+    mSamplesPerChunk = U32_AT(mSampleToChunk + 4);
+    mSampleOffset = getChunkOffset(0);
+    mTimeToSampleIndex = 0;
+    mTimeToSampleRemaining = U32_AT(mTimeToSample);
+    mDecodingTime = 0;
+    mCompositionOffsetIndex = 0;
+    mCompositionOffsetRemaining =
+            mNumCompositionOffsets > 0 ? U32_AT(mCompositionOffsets) : 0;
+    mSyncSampleIndex = 0;
+    return OK;
+}
+
+status_t Mp4Source::stop() {
+    gNumFramesOutput = mNumFramesOutput;
+    return OK;
+}
+
+off64_t Mp4Source::getChunkOffset(uint32_t chunk) const {
+    return mChunkOffsets64 ? (off64_t)U64_AT(mChunkOffsets + 8 * chunk)
+            : (off64_t)U32_AT(mChunkOffsets + 4 * chunk);
+}
+
+status_t Mp4Source::nextChunk() {
+    do {
+        if (++mChunkIndex >= mNumChunks) {
+            return ERROR_MALFORMED;
+        }
+        // stsc first_chunk is 1-based
+        while (mSampleToChunkIndex + 1 < mNumSampleToChunk
+                && U32_AT(mSampleToChunk + 12 * (mSampleToChunkIndex + 1)) <= mChunkIndex + 1) {
+            ++mSampleToChunkIndex;
+        }
+        mSamplesPerChunk = U32_AT(mSampleToChunk + 12 * mSampleToChunkIndex + 4);
+    } while (mSamplesPerChunk == 0);
+
+    mSampleInChunk = 0;
+    mSampleOffset = getChunkOffset(mChunkIndex);
+    return OK;
+}
+
+status_t Mp4Source::read(
+        MediaBuffer **buffer, const MediaSource::ReadOptions *options __unused) {
+
+    if (mNumFramesOutput % 10 == 0) {
+        fprintf(stderr, ".");
+    }
+    if (mMaxNumFrames > 0 && mNumFramesOutput >= mMaxNumFrames) {
+        printf("mMaxNumFrames: %" PRId64 "\n", mMaxNumFrames);
+        return ERROR_END_OF_STREAM;
+    }
+    if (mSampleIndex >= mNumSamples) {
+        printf("end of stream\n");
+        return ERROR_END_OF_STREAM;
+    }
+    if (mTimeLimitUs > 0 && toUs(mDecodingTime) >= mTimeLimitUs) {
+        printf("time limit: %" PRId64 " us\n", mTimeLimitUs);
+        return ERROR_END_OF_STREAM;
+    }
+
+    while (mSampleInChunk >= mSamplesPerChunk) {
+        if (nextChunk() != OK) {
+            fprintf(stderr, "sample %u is past the last chunk\n", mSampleIndex);
+            return ERROR_MALFORMED;
+        }
+    }
+    size_t sampleSize = mConstantSampleSize ? mConstantSampleSize
+            : U32_AT(mSampleSizes + 4 * mSampleIndex);
+
+    status_t err = mGroup.acquire_buffer(buffer);
+    if (err != OK) {
+        return err;
+    }
+
+    // Replace the NAL length prefixes with start codes, in place when they
+    // have the same size.
+    uint8_t* data = (uint8_t*)(*buffer)->data();
+    uint8_t* src = mLengthSize == 4 ? data : mSampleData;
+    size_t in = 0, out = 0;
+    bool ok = pread64(mFd, src, sampleSize, mSampleOffset) == (ssize_t)sampleSize;
+    while (ok && in + mLengthSize <= sampleSize) {
+        size_t nalSize = 0;
+        for (size_t i = 0; i < mLengthSize; ++i) {
+            nalSize = (nalSize << 8) | src[in + i];
+        }
+        in += mLengthSize;
+        if (nalSize > sampleSize - in || out + 4 + nalSize > (*buffer)->size()) {
+            ok = false;
+            break;
+        }
+        memcpy(data + out, kStartCode, 4);
+        if (src != data) {
+            memcpy(data + out + 4, src + in, nalSize);
+        }
+        in += nalSize;
+        out += 4 + nalSize;
+    }
+    if (!ok || in != sampleSize) {
+        fprintf(stderr, "malformed sample %u at %" PRId64 "\n", mSampleIndex, (int64_t)mSampleOffset);
+        (*buffer)->release();
+        *buffer = NULL;
+        return ERROR_MALFORMED;
+    }
+
+    int64_t compositionOffset = 0;
+    if (mCompositionOffsetIndex < mNumCompositionOffsets) {
+        uint32_t value = U32_AT(mCompositionOffsets + 8 * mCompositionOffsetIndex + 4);
+        compositionOffset = mCompositionOffsetsSigned ? (int64_t)(int32_t)value : value;
+    }
+    bool isSync = mSyncSamples == NULL;
+    if (!isSync && mSyncSampleIndex < mNumSyncSamples
+            && U32_AT(mSyncSamples + 4 * mSyncSampleIndex) == mSampleIndex + 1) {
+        isSync = true;
+        ++mSyncSampleIndex;
+    }
+
+    (*buffer)->set_range(0, out);
+    (*buffer)->meta_data()->clear();
+    (*buffer)->meta_data()->setInt32(kKeyIsSyncFrame, isSync);
+    (*buffer)->meta_data()->setInt64(
+            kKeyTime, toUs(mDecodingTime + compositionOffset));
+    (*buffer)->meta_data()->setInt64(
+            kKeyDecodingTime, toUs(mDecodingTime));
+    ++mNumFramesOutput;
+
+    // advance to the next sample
+    ++mSampleIndex;
+    ++mSampleInChunk;
+    mSampleOffset += sampleSize;
+    mDecodingTime += U32_AT(mTimeToSample + 8 * mTimeToSampleIndex + 4);
+    if (--mTimeToSampleRemaining == 0 && mTimeToSampleIndex + 1 < mNumTimeToSample) {
+        ++mTimeToSampleIndex;
+        mTimeToSampleRemaining = U32_AT(mTimeToSample + 8 * mTimeToSampleIndex);
+    }
+    if (mCompositionOffsetIndex < mNumCompositionOffsets && --mCompositionOffsetRemaining == 0) {
+        ++mCompositionOffsetIndex;
+        if (mCompositionOffsetIndex < mNumCompositionOffsets) {
+            mCompositionOffsetRemaining = U32_AT(mCompositionOffsets + 8 * mCompositionOffsetIndex);
+        }
+    }
+
+    return OK;
+}
+
+}  // namespace android
@@ -0,0 +1,106 @@
+#ifndef MP4_SOURCE_H_
+
+#define MP4_SOURCE_H_
+
+#include <media/stagefright/MediaSource.h>
+#include <media/stagefright/MediaBufferGroup.h>
+#include <utils/Compat.h>
+
+namespace android {
+
+// Reads the AVC samples of the first video track of an ISO-BMFF (MP4/MOV)
+// file by walking its sample tables, and outputs them in Annex-B format
+// with their original presentation and decoding times. The avcC box is
+// passed on in the format, so nothing is decoded or re-encoded.
+class Mp4Source : public MediaSource {
+
+public:
+    Mp4Source(int64_t nFrames, const char* filename);
+
+    status_t initCheck() const;
+    int32_t getWidth() const { return mWidth; }
+    int32_t getHeight() const { return mHeight; }
+    int64_t getDurationUs() const;
+    int32_t getBitRate() const;
+    // Ends the stream at the first sample decoded timeLimitUs or more after
+    // the first one. 0 (default) means no limit.
+    void setTimeLimitUs(int64_t timeLimitUs);
+
+    virtual sp<MetaData> getFormat();
+    virtual status_t start(MetaData *params __unused);
+    virtual status_t stop();
+    virtual status_t read(MediaBuffer **buffer, const MediaSource::ReadOptions *options __unused);
+
+protected:
+    virtual ~Mp4Source();
+
+private:
+    status_t mInitCheck;
+    MediaBufferGroup mGroup;
+    int mFd;
+    int64_t mMaxNumFrames;
+    int64_t mTimeLimitUs;
+    int64_t mNumFramesOutput;
+
+    // the whole moov box, the table pointers below point into it
+    uint8_t* mMoov;
+    int32_t mWidth, mHeight;
+    uint32_t mTimeScale;
+    uint64_t mDuration;
+    uint8_t* mAvcC;
+    size_t mAvcCSize;
+    size_t mLengthSize;
+    uint64_t mTotalSampleSize;
+
+    // stsz
+    uint32_t mNumSamples;
+    uint32_t mConstantSampleSize;
+    const uint8_t* mSampleSizes;
+    size_t mMaxSampleSize;
+    // stco / co64
+    uint32_t mNumChunks;
+    const uint8_t* mChunkOffsets;
+    bool mChunkOffsets64;
+    // stsc
+    uint32_t mNumSampleToChunk;
+    const uint8_t* mSampleToChunk;
+    // stts
+    uint32_t mNumTimeToSample;
+    const uint8_t* mTimeToSample;
+    // ctts, optional
+    uint32_t mNumCompositionOffsets;
+    const uint8_t* mCompositionOffsets;
+    bool mCompositionOffsetsSigned;
+    // stss, optional: every sample is a sync sample without it
+    uint32_t mNumSyncSamples;
+    const uint8_t* mSyncSamples;
+
+    // read position in the tables
+    uint32_t mSampleIndex;
+    uint32_t mChunkIndex;
+    uint32_t mSampleInChunk;
+    uint32_t mSamplesPerChunk;
+    uint32_t mSampleToChunkIndex;
+    off64_t mSampleOffset;
+    uint32_t mTimeToSampleIndex;
+    uint32_t mTimeToSampleRemaining;
+    uint64_t mDecodingTime;
+    uint32_t mCompositionOffsetIndex;
+    uint32_t mCompositionOffsetRemaining;
+    uint32_t mSyncSampleIndex;
+    uint8_t* mSampleData;
+
+    status_t parseMoov(const uint8_t* data, size_t size);
+    status_t parseTrack(const uint8_t* data, size_t size);
+    status_t parseSampleTables(const uint8_t* stbl, size_t size);
+    off64_t getChunkOffset(uint32_t chunk) const;
+    status_t nextChunk();
+    int64_t toUs(int64_t time) const;
+
+    Mp4Source(const Mp4Source &);
+    Mp4Source &operator=(const Mp4Source &);
+};
+
+}  // namespace android
+
+#endif // MP4_SOURCE_H_
@@ -0,0 +1,382 @@
+#include "QualityMonitor.h"
+#include "VideoQuality.h"
+
+#include <inttypes.h>
+
+#include <media/stagefright/foundation/ADebug.h>
+#include <media/stagefright/MediaBuffer.h>
+#include <media/stagefright/MediaCodecList.h>
+#include <media/stagefright/MediaErrors.h>
+#include <media/stagefright/MetaData.h>
+#include <media/stagefright/SimpleDecodingSource.h>
+#include <utils/Timers.h>
+
+namespace android {
+
+// Encoded frames waiting to be decoded. When the worker falls this far
+// behind, the measurement stops for the rest of the run instead of
+// buffering without bound.
+static const size_t kMaxEncodedFrames = 32;
+// Frames the encoder and the decoder may hold between them.
+static const size_t kMaxCodecDelayFrames = 16;
+// Reference frames waiting for their decoded counterpart. A reference is
+// queued before the frame enters the encoder, so it has to outlive both
+// codecs and a full encoded queue. Past that the oldest frames are dropped
+// from the measurement rather than stalling the encoder.
+static const size_t kMaxReferences = kMaxEncodedFrames + kMaxCodecDelayFrames;
+
+// Copies of the encoded frames, read by the decoder on the worker thread.
+struct QualityMonitor::EncodedQueue : public MediaSource {
+    EncodedQueue(const sp<IMediaSource> &encoder)
+        : mEncoder(encoder),
+          mEOS(false),
+          mOverflowed(false) {
+    }
+
+    // The encoder only knows its output format (with the codec specific
+    // data) once it produced the first frame, see waitForData().
+    virtual sp<MetaData> getFormat() {
+        return mEncoder->getFormat();
+    }
+
+    virtual status_t start(MetaData *params __unused) {
+        return OK;
+    }
+
+    virtual status_t stop() {
+        Mutex::Autolock autoLock(mLock);
+        mEOS = true;
+        while (!mBuffers.empty()) {
+            (*mBuffers.begin())->release();
+            mBuffers.erase(mBuffers.begin());
+        }
+        mCondition.signal();
+        return OK;
+    }
+
+    virtual status_t read(
+            MediaBuffer **buffer, const MediaSource::ReadOptions *options __unused) {
+        Mutex::Autolock autoLock(mLock);
+        while (mBuffers.empty() && !mEOS) {
+            mCondition.wait(mLock);
+        }
+        if (mBuffers.empty()) {
+            return ERROR_END_OF_STREAM;
+        }
+        *buffer = *mBuffers.begin();
+        mBuffers.erase(mBuffers.begin());
+        return OK;
+    }
+
+    // Takes ownership of buffer.
+    void push(MediaBuffer* buffer) {
+        Mutex::Autolock autoLock(mLock);
+        if (mEOS) {
+            buffer->release();
+            return;
+        }
+        if (mBuffers.size() >= kMaxEncodedFrames) {
+            // let the worker finish what is queued and stop
+            buffer->release();
+            mOverflowed = true;
+            mEOS = true;
+            mCondition.signal();
+            return;
+        }
+        mBuffers.push_back(buffer);
+        mCondition.signal();
+    }
+
+    bool overflowed() {
+        Mutex::Autolock autoLock(mLock);
+        return mOverflowed;
+    }
+
+    void signalEOS() {
+        Mutex::Autolock autoLock(mLock);
+        mEOS = true;
+        mCondition.signal();
+    }
+
+    // Returns false if the stream ended without any frame.
+    bool waitForData() {
+        Mutex::Autolock autoLock(mLock);
+        while (mBuffers.empty() && !mEOS) {
+            mCondition.wait(mLock);
+        }
+        return !mBuffers.empty();
+    }
+
+protected:
+    virtual ~EncodedQueue() {
+        stop();
+    }
+
+private:
+    sp<IMediaSource> mEncoder;
+    Mutex mLock;
+    Condition mCondition;
+    List<MediaBuffer*> mBuffers;
+    bool mEOS;
+    bool mOverflowed;
+};
+
+// Forwards the encoder output to the writer and a copy of it to the queue.
+struct QualityMonitor::TapSource : public MediaSource {
+    TapSource(const sp<IMediaSource> &source, const sp<EncodedQueue> &queue)
+        : mSource(source),
+          mQueue(queue) {
+    }
+
+    virtual sp<MetaData> getFormat() {
+        return mSource->getFormat();
+    }
+
+    virtual status_t start(MetaData *params) {
+        return mSource->start(params);
+    }
+
+    virtual status_t stop() {
+        mQueue->signalEOS();
+        return mSource->stop();
+    }
+
+    virtual status_t read(
+            MediaBuffer **buffer, const MediaSource::ReadOptions *options) {
+        status_t err = mSource->read(buffer, options);
+        if (err != OK) {
+            mQueue->signalEOS();
+            return err;
+        }
+
+        // The codec specific data is part of the encoder format already.
+        int32_t isCodecConfig;
+        int64_t timeUs;
+        if (((*buffer)->meta_data()->findInt32(kKeyIsCodecConfig, &isCodecConfig)
+                && isCodecConfig)
+                || !(*buffer)->meta_data()->findInt64(kKeyTime, &timeUs)) {
+            return OK;
+        }
+
+        MediaBuffer* copy = new MediaBuffer((*buffer)->range_length());
+        memcpy(copy->data(),
+                (const uint8_t*)(*buffer)->data() + (*buffer)->range_offset(),
+                (*buffer)->range_length());
+        copy->meta_data()->setInt64(kKeyTime, timeUs);
+        mQueue->push(copy);
+        return OK;
+    }
+
+private:
+    sp<IMediaSource> mSource;
+    sp<EncodedQueue> mQueue;
+};
+
+QualityMonitor::QualityMonitor(int width, int height, const char* logFile)
+    : mWidth(width),
+      mHeight(height),
+      mLogFile(NULL),
+      mNumReferencesDropped(0),
+      mNumReferencesEvicted(0),
+      mThreadStarted(false),
+      mNumFramesMeasured(0),
+      mTotalSSD(0),
+      mSumPsnr(0),
+      mMinPsnr(100.0),
+      mSumSsim(0),
+      mMinSsim(1.0),
+      mTotalTimeUs(0) {
+
+    if (logFile != NULL) {
+        mLogFile = fopen(logFile, "w");
+        if (mLogFile == NULL) {
+            fprintf(stderr, "couldn't open quality log %s\n", logFile);
+        } else {
+            fprintf(mLogFile, "# frame time_us y_psnr y_ssim\n");
+        }
+    }
+}
+
+QualityMonitor::~QualityMonitor() {
+    waitForCompletion();
+    if (mLogFile != NULL) {
+        fclose(mLogFile);
+    }
+}
+
+sp<MediaSource> QualityMonitor::tap(const sp<IMediaSource> &encoder) {
+    mEncodedQueue = new EncodedQueue(encoder);
+    return new TapSource(encoder, mEncodedQueue);
+}
+
+void QualityMonitor::queueReference(const uint8_t* data, int64_t timeUs) {
+    if (mEncodedQueue != NULL && mEncodedQueue->overflowed()) {
+        Mutex::Autolock autoLock(mLock);
+        ++mNumReferencesDropped;
+        return;
+    }
+
+    Reference ref;
+    ref.mTimeUs = timeUs;
+    ref.mData = new uint8_t[mWidth * mHeight];
+    memcpy(ref.mData, data, mWidth * mHeight);
+
+    Mutex::Autolock autoLock(mLock);
+    if (mReferences.size() >= kMaxReferences) {
+        delete[] (*mReferences.begin()).mData;
+        mReferences.erase(mReferences.begin());
+        ++mNumReferencesDropped;
+        ++mNumReferencesEvicted;
+    }
+    mReferences.push_back(ref);
+}
+
+status_t QualityMonitor::start() {
+    CHECK(mEncodedQueue != NULL);
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
+    int err = pthread_create(&mThread, &attr, ThreadWrapper, this);
+    pthread_attr_destroy(&attr);
+    if (err != 0) {
+        return UNKNOWN_ERROR;
+    }
+    mThreadStarted = true;
+    return OK;
+}
+
+void QualityMonitor::stop() {
+    if (mEncodedQueue != NULL) {
+        mEncodedQueue->signalEOS();
+    }
+}
+
+void QualityMonitor::waitForCompletion() {
+    if (mThreadStarted) {
+        pthread_join(mThread, NULL);
+        mThreadStarted = false;
+    }
+
+    // Whatever is left never came out of the encoder.
+    Mutex::Autolock autoLock(mLock);
+    while (!mReferences.empty()) {
+        delete[] (*mReferences.begin()).mData;
+        mReferences.erase(mReferences.begin());
+        ++mNumReferencesDropped;
+    }
+}
+
+// static
+void *QualityMonitor::ThreadWrapper(void *me) {
+    static_cast<QualityMonitor *>(me)->threadFunc();
+    return NULL;
+}
+
+void QualityMonitor::threadFunc() {
+    if (!mEncodedQueue->waitForData()) {
+        return;
+    }
+
+    // Software decoders always output readable YUV420, vendor ones may not.
+    sp<SimpleDecodingSource> decoder = SimpleDecodingSource::Create(
+            mEncodedQueue, MediaCodecList::kPreferSoftwareCodecs);
+    if (decoder == NULL || decoder->start() != OK) {
+        fprintf(stderr, "couldn't start decoder for quality measurement\n");
+        mEncodedQueue->stop();
+        return;
+    }
+
+    int32_t stride = mWidth;
+    size_t lumaOffset = 0;
+    bool formatKnown = false;
+    while (true) {
+        if (!formatKnown) {
+            lumaOffset = getLumaOffset(decoder->getFormat(), &stride);
+            formatKnown = true;
+        }
+
+        MediaBuffer* buffer;
+        status_t err = decoder->read(&buffer);
+        if (err == INFO_FORMAT_CHANGED) {
+            formatKnown = false;
+            continue;
+        } else if (err != OK) {
+            break;
+        }
+
+        int64_t timeUs;
+        if (buffer->range_length() > 0
+                && buffer->meta_data()->findInt64(kKeyTime, &timeUs)) {
+            measureFrame((const uint8_t*)buffer->data() + buffer->range_offset()
+                    + lumaOffset, stride, timeUs);
+        }
+        buffer->release();
+    }
+    decoder->stop();
+}
+
+void QualityMonitor::measureFrame(const uint8_t* decoded, int32_t stride, int64_t timeUs) {
+    Reference ref;
+    bool found = false;
+    {
+        Mutex::Autolock autoLock(mLock);
+        while (!mReferences.empty() && (*mReferences.begin()).mTimeUs <= timeUs) {
+            ref = *mReferences.begin();
+            mReferences.erase(mReferences.begin());
+            if (ref.mTimeUs == timeUs) {
+                found = true;
+                break;
+            }
+            // dropped by the encoder
+            delete[] ref.mData;
+            ++mNumReferencesDropped;
+        }
+    }
+    if (!found) {
+        return;
+    }
+
+    int64_t startUs = systemTime() / 1000;
+    uint64_t ssd = computePlaneSSD(ref.mData, mWidth, decoded, stride, mWidth, mHeight);
+    double psnr = mseToPsnr((double)ssd / (mWidth * mHeight));
+    double ssim = computePlaneSSIM(ref.mData, mWidth, decoded, stride, mWidth, mHeight);
+    mTotalTimeUs += systemTime() / 1000 - startUs;
+    delete[] ref.mData;
+
+    if (mLogFile != NULL) {
+        fprintf(mLogFile, "%" PRId64 " %" PRId64 " %.3f %.5f\n",
+                mNumFramesMeasured, timeUs, psnr, ssim);
+    }
+    ++mNumFramesMeasured;
+    mTotalSSD += ssd;
+    mSumPsnr += psnr;
+    mSumSsim += ssim;
+    if (psnr < mMinPsnr) mMinPsnr = psnr;
+    if (ssim < mMinSsim) mMinSsim = ssim;
+}
+
+void QualityMonitor::dumpStats(FILE* out) {
+    fprintf(out, "quality: %" PRId64 " frames measured, %" PRId64 " not measured\n",
+            mNumFramesMeasured, mNumReferencesDropped);
+    if (mEncodedQueue != NULL && mEncodedQueue->overflowed()) {
+        fprintf(out, "quality: the worker thread fell behind, "
+                "measurement stopped after %" PRId64 " frames\n", mNumFramesMeasured);
+    }
+    if (mNumReferencesEvicted > 0) {
+        fprintf(out, "quality: %" PRId64 " frames dropped, the worker thread fell "
+                "behind by more than %zu frames\n", mNumReferencesEvicted, kMaxReferences);
+    }
+    if (mNumFramesMeasured == 0) {
+        return;
+    }
+    double mse = (double)mTotalSSD / ((double)mNumFramesMeasured * mWidth * mHeight);
+    fprintf(out, "quality: Y-PSNR %.2f dB (frame average %.2f, min %.2f)\n",
+            mseToPsnr(mse), mSumPsnr / mNumFramesMeasured, mMinPsnr);
+    fprintf(out, "quality: Y-SSIM %.4f (min %.4f)\n",
+            mSumSsim / mNumFramesMeasured, mMinSsim);
+    fprintf(out, "quality: %.2f ms per frame on the worker thread\n",
+            mTotalTimeUs / 1000.0 / mNumFramesMeasured);
+}
+
+}  // namespace android
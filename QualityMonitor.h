@@ -0,0 +1,80 @@
+#ifndef QUALITY_MONITOR_H_
+
+#define QUALITY_MONITOR_H_
+
+#include <pthread.h>
+#include <stdio.h>
+
+#include <media/stagefright/MediaSource.h>
+#include <utils/Condition.h>
+#include <utils/List.h>
+#include <utils/Mutex.h>
+#include <utils/RefBase.h>
+
+namespace android {
+
+// Decodes the encoder output on a worker thread while it is being muxed, and
+// compares every decoded frame with the YUV frame it was encoded from.
+// Only the luma plane is compared, so the result does not depend on the
+// color format chosen by the encoder or the decoder.
+class QualityMonitor : public RefBase {
+
+public:
+    QualityMonitor(int width, int height, const char* logFile);
+
+    // Returns a source forwarding everything read from encoder.
+    // The writer should read from it instead of from the encoder.
+    sp<MediaSource> tap(const sp<IMediaSource> &encoder);
+
+    // Keeps a copy of the luma plane of a frame handed to the encoder.
+    void queueReference(const uint8_t* data, int64_t timeUs);
+
+    status_t start();
+    // Ends the measurement after the frames already encoded, for error
+    // exits where the tapped encoder is not stopped.
+    void stop();
+    // Waits until every encoded frame has been decoded and measured.
+    // Must be called after the writer has been stopped.
+    void waitForCompletion();
+    void dumpStats(FILE* out);
+
+protected:
+    virtual ~QualityMonitor();
+
+private:
+    struct Reference {
+        int64_t mTimeUs;
+        uint8_t* mData;
+    };
+    struct EncodedQueue;
+    struct TapSource;
+
+    int mWidth, mHeight;
+    FILE* mLogFile;
+    sp<EncodedQueue> mEncodedQueue;
+
+    Mutex mLock;
+    List<Reference> mReferences;
+    int64_t mNumReferencesDropped;
+    int64_t mNumReferencesEvicted;  // dropped because the worker fell behind
+
+    pthread_t mThread;
+    bool mThreadStarted;
+
+    int64_t mNumFramesMeasured;
+    uint64_t mTotalSSD;
+    double mSumPsnr, mMinPsnr;
+    double mSumSsim, mMinSsim;
+    int64_t mTotalTimeUs;
+
+    static void *ThreadWrapper(void *me);
+    void threadFunc();
+    void measureFrame(const uint8_t* decoded, int32_t stride, int64_t timeUs);
+
+    QualityMonitor(const QualityMonitor &);
+    QualityMonitor &operator=(const QualityMonitor &);
+};
+
+}  // namespace android
+
+#endif // QUALITY_MONITOR_H_
@@ -0,0 +1,168 @@
+#include "SegmentSource.h"
+
+#include <media/stagefright/foundation/ADebug.h>
+#include <media/stagefright/MediaBuffer.h>
+#include <media/stagefright/MediaErrors.h>
+#include <media/stagefright/MetaData.h>
+
+namespace android {
+
+static MediaBuffer* copyBuffer(MediaBuffer* buffer) {
+    MediaBuffer* copy = new MediaBuffer(buffer->range_length());
+    memcpy(copy->data(),
+            (const uint8_t*)buffer->data() + buffer->range_offset(),
+            buffer->range_length());
+    copy->meta_data()->setInt32(kKeyIsCodecConfig, true);
+    return copy;
+}
+
+SegmentSource::SegmentSource(const sp<IMediaSource> &source, int64_t maxDurationUs, int64_t maxBytes)
+    : mSource(source),
+      mMaxDurationUs(maxDurationUs),
+      mMaxBytes(maxBytes),
+      mStarted(false),
+      mCodecConfig(NULL),
+      mPendingBuffer(NULL),
+      mNeedCodecConfig(false),
+      mSegmentEnded(false),
+      mIDRRequested(false),
+      mSegmentStartTimeUs(0),
+      mSegmentBytes(0) {
+}
+
+SegmentSource::~SegmentSource() {
+    if (mCodecConfig != NULL) {
+        mCodecConfig->release();
+    }
+    if (mPendingBuffer != NULL) {
+        mPendingBuffer->release();
+    }
+}
+
+void SegmentSource::setEncoder(const sp<MediaCodecSource> &encoder) {
+    mEncoder = encoder;
+}
+
+void SegmentSource::setLatencyTracker(const sp<LatencyTracker> &tracker) {
+    mLatencyTracker = tracker;
+}
+
+sp<MetaData> SegmentSource::getFormat() {
+    return mSource->getFormat();
+}
+
+status_t SegmentSource::start(MetaData *params) {
+    if (mPendingBuffer != NULL) {
+        mSegmentEnded = false;
+        mNeedCodecConfig = true;
+    }
+    mSegmentStartTimeUs = 0;
+    mSegmentBytes = 0;
+    mIDRRequested = false;
+
+    if (mStarted) {
+        return OK;
+    }
+    mStarted = true;
+    return mSource->start(params);
+}
+
+status_t SegmentSource::stop() {
+    if (hasNextSegment() || !mStarted) {
+        return OK;
+    }
+    mStarted = false;
+    return mSource->stop();
+}
+
+status_t SegmentSource::forceStop() {
+    if (!mStarted) {
+        return OK;
+    }
+    mStarted = false;
+    return mSource->stop();
+}
+
+bool SegmentSource::hasNextSegment() const {
+    return mSegmentEnded && mPendingBuffer != NULL;
+}
+
+bool SegmentSource::isSegmentFull(int64_t timeUs) const {
+    return (mMaxDurationUs > 0 && timeUs - mSegmentStartTimeUs >= mMaxDurationUs)
+            || (mMaxBytes > 0 && mSegmentBytes >= mMaxBytes);
+}
+
+status_t SegmentSource::read(
+        MediaBuffer **buffer, const MediaSource::ReadOptions *options) {
+    *buffer = NULL;
+    if (mSegmentEnded) {
+        return ERROR_END_OF_STREAM;
+    }
+
+    if (mNeedCodecConfig) {
+        mNeedCodecConfig = false;
+        if (mCodecConfig != NULL) {
+            *buffer = copyBuffer(mCodecConfig);
+            return OK;
+        }
+    }
+
+    MediaBuffer* buf;
+    if (mPendingBuffer != NULL) {
+        buf = mPendingBuffer;
+        mPendingBuffer = NULL;
+    } else {
+        status_t err = mSource->read(&buf, options);
+        if (err != OK) {
+            return err;
+        }
+    }
+
+    sp<MetaData> meta = buf->meta_data();
+    int32_t isCodecConfig;
+    if (meta->findInt32(kKeyIsCodecConfig, &isCodecConfig) && isCodecConfig) {
+        // replayed at the start of every following segment
+        if (mCodecConfig != NULL) {
+            mCodecConfig->release();
+        }
+        mCodecConfig = copyBuffer(buf);
+        *buffer = buf;
+        return OK;
+    }
+
+    int64_t timeUs = 0, decodingTimeUs;
+    int32_t isSync = 0;
+    meta->findInt64(kKeyTime, &timeUs);
+    bool hasDecodingTime = meta->findInt64(kKeyDecodingTime, &decodingTimeUs);
+    if (!hasDecodingTime) {
+        decodingTimeUs = timeUs;
+    }
+    meta->findInt32(kKeyIsSyncFrame, &isSync);
+
+    if (mSegmentBytes == 0) {
+        mSegmentStartTimeUs = decodingTimeUs;
+    } else if (isSegmentFull(decodingTimeUs)) {
+        if (isSync) {
+            mPendingBuffer = buf;
+            mSegmentEnded = true;
+            return ERROR_END_OF_STREAM;
+        }
+        if (mEncoder != NULL && !mIDRRequested) {
+            mEncoder->requestIDRFrame();
+            mIDRRequested = true;
+        }
+    }
+
+    if (mLatencyTracker != NULL) {
+        mLatencyTracker->onMuxed(timeUs);
+    }
+    meta->setInt64(kKeyTime, timeUs - mSegmentStartTimeUs);
+    if (hasDecodingTime) {
+        meta->setInt64(kKeyDecodingTime, decodingTimeUs - mSegmentStartTimeUs);
+    }
+    mSegmentBytes += buf->range_length();
+    *buffer = buf;
+    return OK;
+}
+
+}  // namespace android
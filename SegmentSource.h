@@ -0,0 +1,67 @@
+#ifndef SEGMENT_SOURCE_H_
+
+#define SEGMENT_SOURCE_H_
+
+#include <media/stagefright/MediaCodecSource.h>
+#include <media/stagefright/MediaSource.h>
+#include <utils/Compat.h>
+
+#include "LatencyTracker.h"
+
+namespace android {
+
+// Splits the stream read from source into segments, each one starting with
+// the codec config and a sync frame, so that every segment can be written
+// by its own MPEG4Writer. A segment ends at the first sync frame after it
+// reached maxDurationUs or maxBytes (0 means no limit). The sync frame is
+// held back and returned first by the next segment, once start() is called
+// again. Timestamps are rebased to start at 0 in every segment.
+class SegmentSource : public MediaSource {
+
+public:
+    SegmentSource(const sp<IMediaSource> &source, int64_t maxDurationUs, int64_t maxBytes);
+
+    // Lets the source request a sync frame from encoder as soon as the
+    // current segment is full, instead of waiting for the next periodic one.
+    void setEncoder(const sp<MediaCodecSource> &encoder);
+    // Reports every frame handed to the writer to tracker.
+    void setLatencyTracker(const sp<LatencyTracker> &tracker);
+
+    virtual sp<MetaData> getFormat();
+    virtual status_t start(MetaData *params);
+    virtual status_t stop();
+    // Stops the source even between two segments, after an error.
+    status_t forceStop();
+    virtual status_t read(MediaBuffer **buffer, const MediaSource::ReadOptions *options);
+
+    // True if the last segment ended at a split point rather than at the end
+    // of the stream.
+    bool hasNextSegment() const;
+
+protected:
+    virtual ~SegmentSource();
+
+private:
+    sp<IMediaSource> mSource;
+    sp<MediaCodecSource> mEncoder;
+    sp<LatencyTracker> mLatencyTracker;
+    int64_t mMaxDurationUs;
+    int64_t mMaxBytes;
+    bool mStarted;
+    MediaBuffer* mCodecConfig;
+    MediaBuffer* mPendingBuffer;
+    bool mNeedCodecConfig;
+    bool mSegmentEnded;
+    bool mIDRRequested;
+    int64_t mSegmentStartTimeUs;
+    int64_t mSegmentBytes;
+
+    bool isSegmentFull(int64_t timeUs) const;
+
+    SegmentSource(const SegmentSource &);
+    SegmentSource &operator=(const SegmentSource &);
+};
+
+}  // namespace android
+
+#endif // SEGMENT_SOURCE_H_
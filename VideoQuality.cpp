@@ -0,0 +1,298 @@
+#include "VideoQuality.h"
+
+#include <math.h>
+
+#if defined(__ARM_NEON__) || defined(__aarch64__)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include <media/stagefright/foundation/ADebug.h>
+#include <media/stagefright/DataSource.h>
+#include <media/stagefright/FileSource.h>
+#include <media/stagefright/MediaBuffer.h>
+#include <media/stagefright/MediaCodecList.h>
+#include <media/stagefright/MediaDefs.h>
+#include <media/stagefright/MediaErrors.h>
+#include <media/stagefright/MediaExtractor.h>
+#include <media/stagefright/MetaData.h>
+#include <media/stagefright/SimpleDecodingSource.h>
+
+namespace android {
+
+#if defined(__ARM_NEON__) || defined(__aarch64__)
+
+static inline uint64_t horizontalSum(uint32x4_t v) {
+    uint64x2_t sum = vpaddlq_u32(v);
+    return vgetq_lane_u64(sum, 0) + vgetq_lane_u64(sum, 1);
+}
+
+// Returns the SSD of a row, 16 samples at a time.
+static inline uint64_t rowSSD(const uint8_t* a, const uint8_t* b, int width, int* done) {
+    uint32x4_t acc = vdupq_n_u32(0);
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        uint8x16_t diff = vabdq_u8(vld1q_u8(a + x), vld1q_u8(b + x));
+        acc = vpadalq_u16(acc, vmull_u8(vget_low_u8(diff), vget_low_u8(diff)));
+        acc = vpadalq_u16(acc, vmull_u8(vget_high_u8(diff), vget_high_u8(diff)));
+    }
+    *done = x;
+    return horizontalSum(acc);
+}
+
+// Sums of a, b, a*a, b*b and a*b over an 8x8 window.
+static inline void blockStats8x8(const uint8_t* a, size_t aStride,
+        const uint8_t* b, size_t bStride, uint32_t stats[5]) {
+    uint16x8_t sumA = vdupq_n_u16(0), sumB = vdupq_n_u16(0);
+    uint32x4_t sumAA = vdupq_n_u32(0), sumBB = vdupq_n_u32(0), sumAB = vdupq_n_u32(0);
+    for (int y = 0; y < 8; ++y, a += aStride, b += bStride) {
+        uint8x8_t va = vld1_u8(a);
+        uint8x8_t vb = vld1_u8(b);
+        sumA = vaddw_u8(sumA, va);
+        sumB = vaddw_u8(sumB, vb);
+        sumAA = vpadalq_u16(sumAA, vmull_u8(va, va));
+        sumBB = vpadalq_u16(sumBB, vmull_u8(vb, vb));
+        sumAB = vpadalq_u16(sumAB, vmull_u8(va, vb));
+    }
+    stats[0] = horizontalSum(vpaddlq_u16(sumA));
+    stats[1] = horizontalSum(vpaddlq_u16(sumB));
+    stats[2] = horizontalSum(sumAA);
+    stats[3] = horizontalSum(sumBB);
+    stats[4] = horizontalSum(sumAB);
+}
+
+#elif defined(__SSE2__)
+
+static inline uint64_t horizontalSum(__m128i v) {
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+    return (uint32_t)_mm_cvtsi128_si32(v);
+}
+
+// Returns the SSD of a row, 16 samples at a time.
+static inline uint64_t rowSSD(const uint8_t* a, const uint8_t* b, int width, int* done) {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i acc = _mm_setzero_si128();
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m128i va = _mm_loadu_si128((const __m128i*)(a + x));
+        __m128i vb = _mm_loadu_si128((const __m128i*)(b + x));
+        __m128i diff = _mm_or_si128(_mm_subs_epu8(va, vb), _mm_subs_epu8(vb, va));
+        __m128i lo = _mm_unpacklo_epi8(diff, zero);
+        __m128i hi = _mm_unpackhi_epi8(diff, zero);
+        acc = _mm_add_epi32(acc, _mm_madd_epi16(lo, lo));
+        acc = _mm_add_epi32(acc, _mm_madd_epi16(hi, hi));
+    }
+    *done = x;
+    return horizontalSum(acc);
+}
+
+// Sums of a, b, a*a, b*b and a*b over an 8x8 window.
+static inline void blockStats8x8(const uint8_t* a, size_t aStride,
+        const uint8_t* b, size_t bStride, uint32_t stats[5]) {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i sumA = zero, sumB = zero, sumAA = zero, sumBB = zero, sumAB = zero;
+    for (int y = 0; y < 8; ++y, a += aStride, b += bStride) {
+        __m128i va = _mm_loadl_epi64((const __m128i*)a);
+        __m128i vb = _mm_loadl_epi64((const __m128i*)b);
+        sumA = _mm_add_epi64(sumA, _mm_sad_epu8(va, zero));
+        sumB = _mm_add_epi64(sumB, _mm_sad_epu8(vb, zero));
+        va = _mm_unpacklo_epi8(va, zero);
+        vb = _mm_unpacklo_epi8(vb, zero);
+        sumAA = _mm_add_epi32(sumAA, _mm_madd_epi16(va, va));
+        sumBB = _mm_add_epi32(sumBB, _mm_madd_epi16(vb, vb));
+        sumAB = _mm_add_epi32(sumAB, _mm_madd_epi16(va, vb));
+    }
+    stats[0] = _mm_cvtsi128_si32(sumA);
+    stats[1] = _mm_cvtsi128_si32(sumB);
+    stats[2] = horizontalSum(sumAA);
+    stats[3] = horizontalSum(sumBB);
+    stats[4] = horizontalSum(sumAB);
+}
+
+#else
+
+static inline uint64_t rowSSD(const uint8_t* a __unused, const uint8_t* b __unused,
+        int width __unused, int* done) {
+    *done = 0;
+    return 0;
+}
+
+static inline void blockStats8x8(const uint8_t* a, size_t aStride,
+        const uint8_t* b, size_t bStride, uint32_t stats[5]) {
+    memset(stats, 0, 5 * sizeof(uint32_t));
+    for (int y = 0; y < 8; ++y, a += aStride, b += bStride) {
+        for (int x = 0; x < 8; ++x) {
+            stats[0] += a[x];
+            stats[1] += b[x];
+            stats[2] += a[x] * a[x];
+            stats[3] += b[x] * b[x];
+            stats[4] += a[x] * b[x];
+        }
+    }
+}
+
+#endif
+
+uint64_t computePlaneSSD(const uint8_t* a, size_t aStride,
+        const uint8_t* b, size_t bStride, int width, int height) {
+    uint64_t ssd = 0;
+    for (int y = 0; y < height; ++y) {
+        int x;
+        ssd += rowSSD(a, b, width, &x);
+        // scalar tail
+        for (; x < width; ++x) {
+            int diff = a[x] - b[x];
+            ssd += diff * diff;
+        }
+        a += aStride;
+        b += bStride;
+    }
+    return ssd;
+}
+
+double computePlaneSSIM(const uint8_t* a, size_t aStride,
+        const uint8_t* b, size_t bStride, int width, int height) {
+    // (K1 * 255)^2 and (K2 * 255)^2, scaled by the 64 samples of a window
+    static const double kC1 = 6.5025 * 64 * 64;
+    static const double kC2 = 58.5225 * 64 * 64;
+    double sum = 0;
+    int numBlocks = 0;
+
+    for (int y = 0; y + 8 <= height; y += 8) {
+        for (int x = 0; x + 8 <= width; x += 8) {
+            uint32_t stats[5];
+            blockStats8x8(a + y * aStride + x, aStride, b + y * bStride + x, bStride, stats);
+            double sa = stats[0], sb = stats[1];
+            double varA = 64.0 * stats[2] - sa * sa;
+            double varB = 64.0 * stats[3] - sb * sb;
+            double cov = 64.0 * stats[4] - sa * sb;
+            sum += ((2 * sa * sb + kC1) * (2 * cov + kC2))
+                    / ((sa * sa + sb * sb + kC1) * (varA + varB + kC2));
+            ++numBlocks;
+        }
+    }
+    return numBlocks > 0 ? sum / numBlocks : 1.0;
+}
+
+double mseToPsnr(double mse) {
+    if (mse <= 0) {
+        return 100.0;
+    }
+    return 10.0 * log10((255.0 * 255.0) / mse);
+}
+
+size_t getLumaOffset(const sp<MetaData> &format, int32_t* stride) {
+    int32_t cropLeft, cropTop, cropRight, cropBottom;
+    if (!format->findInt32(kKeyStride, stride)) {
+        format->findInt32(kKeyWidth, stride);
+    }
+    if (!format->findRect(kKeyCropRect,
+            &cropLeft, &cropTop, &cropRight, &cropBottom)) {
+        return 0;
+    }
+    return cropTop * *stride + cropLeft;
+}
+
+status_t measureFilePsnr(const char* mp4File, const char* yuvFile,
+        int width, int height, float frameRate, int64_t maxFrames,
+        double* psnr, int64_t* numFrames) {
+    *psnr = 0;
+    *numFrames = 0;
+
+    sp<DataSource> dataSource = new FileSource(mp4File);
+    if (dataSource->initCheck() != OK) {
+        fprintf(stderr, "couldn't open %s\n", mp4File);
+        return UNKNOWN_ERROR;
+    }
+    sp<IMediaExtractor> extractor = MediaExtractor::Create(dataSource);
+    if (extractor == NULL || extractor->countTracks() == 0) {
+        fprintf(stderr, "couldn't extract %s\n", mp4File);
+        return UNKNOWN_ERROR;
+    }
+
+    // Software decoders always output readable YUV420, vendor ones may not.
+    sp<SimpleDecodingSource> decoder = SimpleDecodingSource::Create(
+            extractor->getTrack(0), MediaCodecList::kPreferSoftwareCodecs);
+    if (decoder == NULL) {
+        fprintf(stderr, "couldn't create decoder for %s\n", mp4File);
+        return UNKNOWN_ERROR;
+    }
+
+    FILE* yuv = fopen(yuvFile, "rb");
+    if (yuv == NULL) {
+        fprintf(stderr, "couldn't open %s\n", yuvFile);
+        return UNKNOWN_ERROR;
+    }
+
+    status_t err = decoder->start();
+    if (err != OK) {
+        fclose(yuv);
+        return err;
+    }
+
+    size_t frameSize = (width * height * 3) / 2;
+    uint8_t* frame = new uint8_t[frameSize];
+    int32_t stride = width;
+    size_t lumaOffset = 0;
+    bool formatKnown = false;
+    uint64_t totalSsd = 0;
+    int64_t nextFrameIndex = 0;     // frame at the current yuv file position
+
+    while (maxFrames == 0 || *numFrames < maxFrames) {
+        if (!formatKnown) {
+            lumaOffset = getLumaOffset(decoder->getFormat(), &stride);
+            formatKnown = true;
+        }
+
+        MediaBuffer* buffer;
+        err = decoder->read(&buffer);
+        if (err == INFO_FORMAT_CHANGED) {
+            formatKnown = false;
+            continue;
+        } else if (err != OK) {
+            break;
+        }
+        if (buffer->range_length() == 0) {
+            buffer->release();
+            continue;
+        }
+
+        // The encoder may skip frames, find the source frame by timestamp.
+        int64_t timeUs;
+        int64_t frameIndex = nextFrameIndex;
+        if (buffer->meta_data()->findInt64(kKeyTime, &timeUs)) {
+            frameIndex = llround(timeUs * frameRate / 1E6);
+        }
+        if (frameIndex != nextFrameIndex
+                && fseeko64(yuv, (off64_t)frameIndex * frameSize, SEEK_SET) != 0) {
+            buffer->release();
+            break;
+        }
+        if (fread(frame, 1, frameSize, yuv) != frameSize) {
+            buffer->release();
+            break;
+        }
+        nextFrameIndex = frameIndex + 1;
+
+        const uint8_t* decoded = (const uint8_t*)buffer->data()
+                + buffer->range_offset() + lumaOffset;
+        totalSsd += computePlaneSSD(frame, width, decoded, stride, width, height);
+        buffer->release();
+        ++*numFrames;
+    }
+
+    decoder->stop();
+    delete[] frame;
+    fclose(yuv);
+
+    if (*numFrames == 0) {
+        fprintf(stderr, "no frames decoded from %s\n", mp4File);
+        return ERROR_MALFORMED;
+    }
+    *psnr = mseToPsnr((double)totalSsd / ((double)*numFrames * width * height));
+    return OK;
+}
+
+}  // namespace android
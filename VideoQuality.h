@@ -0,0 +1,38 @@
+#ifndef VIDEO_QUALITY_H_
+
+#define VIDEO_QUALITY_H_
+
+#include <media/stagefright/MetaData.h>
+#include <utils/Errors.h>
+
+namespace android {
+
+// Sum of squared differences between two 8-bit planes.
+uint64_t computePlaneSSD(const uint8_t* a, size_t aStride,
+        const uint8_t* b, size_t bStride, int width, int height);
+
+// Mean SSIM of two 8-bit planes over non-overlapping 8x8 windows.
+// Border pixels not covered by a full window are ignored.
+double computePlaneSSIM(const uint8_t* a, size_t aStride,
+        const uint8_t* b, size_t bStride, int width, int height);
+
+// Converts a mean squared error of 8-bit samples to PSNR in dB.
+// A zero error is reported as 100 dB.
+double mseToPsnr(double mse);
+
+// Returns the offset of the first visible luma sample of a decoded frame
+// described by format, and its row stride in *stride.
+size_t getLumaOffset(const sp<MetaData> &format, int32_t* stride);
+
+// Decodes the first video track of mp4File and compares its luma against the
+// planar/semi-planar YUV420 frames of yuvFile. Decoded frames are matched to
+// the YUV frame at their timestamp, at frameRate, so frames skipped by the
+// encoder are not compared. At most maxFrames frames are compared (0 means
+// all). Returns the aggregate Y-PSNR in *psnr.
+status_t measureFilePsnr(const char* mp4File, const char* yuvFile,
+        int width, int height, float frameRate, int64_t maxFrames,
+        double* psnr, int64_t* numFrames);
+
+}  // namespace android
+
+#endif // VIDEO_QUALITY_H_
@@ -1,21 +1,33 @@
 #include "YuvSource.h"
+
+#include <errno.h>
+#include <time.h>
 
 #include <media/stagefright/MediaBufferGroup.h>
 #include <media/stagefright/foundation/ADebug.h>
 #include <media/stagefright/MediaDefs.h>
 #include <media/stagefright/MetaData.h>
 
-extern int32_t gNumFramesOutput;
+extern int64_t gNumFramesOutput;
 namespace android {
 
-YuvSource::YuvSource(int width, int height, int nFrames, int fps, int colorFormat, const char* filename)
+YuvSource::YuvSource(int width, int height, int64_t nFrames, float fps, int colorFormat, const char* filename)
     : mWidth(width),
       mHeight(height),
       mMaxNumFrames(nFrames),
       mFrameRate(fps),
       mColorFormat(colorFormat),
-      mSize((width * height * 3) / 2) {
+      mSize((width * height * 3) / 2),
+      mFile(NULL),
+      mRealTime(false),
+      mStartTimeNs(0),
+      mDecompressThreads(0) {
 
+    if (filename != NULL && CompressedYuvReader::isCompressed(filename)) {
+        // frames are decompressed into the reader's own buffers
+        mReader = new CompressedYuvReader(filename);
+        return;
+    }
     mGroup.add_buffer(new MediaBuffer(mSize));
     if (filename != NULL) {
         mFile = fopen(filename, "rb");
@@ -39,12 +51,30 @@ sp<MetaData> YuvSource::getFormat() {
 }
 
 status_t YuvSource::start(MetaData *params __unused) {
+    if (mReader != NULL) {
+        // start() reports why the file could not be read
+        if (mReader->initCheck() == OK && (mReader->getWidth() != mWidth
+                || mReader->getHeight() != mHeight || mReader->getFrameSize() != mSize)) {
+            fprintf(stderr, "compressed YUV frames are %dx%d, %zu bytes, expected %dx%d, %zu\n",
+                    mReader->getWidth(), mReader->getHeight(), mReader->getFrameSize(),
+                    mWidth, mHeight, mSize);
+            return BAD_VALUE;
+        }
+        status_t err = mReader->start(mDecompressThreads, mMaxNumFrames);
+        if (err != OK) {
+            return err;
+        }
+    }
     mNumFramesOutput = 0;
     gNumFramesOutput = 0;
+    mStartTimeNs = systemTime(SYSTEM_TIME_MONOTONIC);
     return OK;
 }
 
 status_t YuvSource::stop() {
+    if (mReader != NULL) {
+        mReader->stop();
+    }
     gNumFramesOutput = mNumFramesOutput;
     return OK;
 }
@@ -55,12 +85,15 @@ status_t YuvSource::read(
     if (mNumFramesOutput % 10 == 0) {
         fprintf(stderr, ".");
     }
-    if (mNumFramesOutput == mMaxNumFrames) {
+    if (mMaxNumFrames > 0 && mNumFramesOutput >= mMaxNumFrames) {
         return ERROR_END_OF_STREAM;
     }
 
-    status_t err = mGroup.acquire_buffer(buffer);
+    status_t err = mReader != NULL ? mReader->read(buffer) : mGroup.acquire_buffer(buffer);
     if (err != OK) {
+        if (err == ERROR_END_OF_STREAM) {
+            printf("end of stream\n");
+        }
         return err;
     }
 
@@ -73,13 +106,47 @@ status_t YuvSource::read(
         }
     }
 
+    int64_t timeUs = (int64_t)(mNumFramesOutput * 1E6 / mFrameRate);
+    if (mRealTime) {
+        // The frame is already read or decompressed, release it on time
+        // without adding the input latency to it.
+        nsecs_t dueNs = mStartTimeNs + (nsecs_t)(mNumFramesOutput * 1E9 / mFrameRate);
+        struct timespec due;
+        due.tv_sec = dueNs / 1000000000ll;
+        due.tv_nsec = dueNs % 1000000000ll;
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &due, NULL) == EINTR) {
+        }
+        timeUs = (systemTime(SYSTEM_TIME_MONOTONIC) - mStartTimeNs) / 1000;
+    }
     (*buffer)->set_range(0, mSize);
     (*buffer)->meta_data()->clear();
-    (*buffer)->meta_data()->setInt64(
-            kKeyTime, (mNumFramesOutput * 1000000) / mFrameRate);
+    (*buffer)->meta_data()->setInt64(kKeyTime, timeUs);
     ++mNumFramesOutput;
 
+    if (mQualityMonitor != NULL) {
+        mQualityMonitor->queueReference((const uint8_t*)(*buffer)->data(), timeUs);
+    }
+    if (mLatencyTracker != NULL) {
+        mLatencyTracker->onCaptured(timeUs);
+    }
+
     return OK;
 }
 
+void YuvSource::setQualityMonitor(const sp<QualityMonitor> &monitor) {
+    mQualityMonitor = monitor;
+}
+
+void YuvSource::setRealTime(bool realTime) {
+    mRealTime = realTime;
+}
+
+void YuvSource::setLatencyTracker(const sp<LatencyTracker> &tracker) {
+    mLatencyTracker = tracker;
+}
+
+void YuvSource::setDecompressThreads(int numThreads) {
+    mDecompressThreads = numThreads;
+}
+
 }  // namespace android
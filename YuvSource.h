@@ -5,18 +5,30 @@
 #include <media/stagefright/MediaSource.h>
 #include <media/stagefright/MediaBufferGroup.h>
 #include <utils/Compat.h>
+
+#include "CompressedYuvReader.h"
+#include "LatencyTracker.h"
+#include "QualityMonitor.h"
 
 namespace android {
 
 class YuvSource : public MediaSource {
 
 public:
-    YuvSource(int width, int height, int nFrames, int fps, int colorFormat, const char* filename);
+    YuvSource(int width, int height, int64_t nFrames, float fps, int colorFormat, const char* filename);
     virtual sp<MetaData> getFormat();
     virtual status_t start(MetaData *params __unused);
     virtual status_t stop();
     virtual status_t read(
             MediaBuffer **buffer, const MediaSource::ReadOptions *options __unused);
+    void setQualityMonitor(const sp<QualityMonitor> &monitor);
+    // Releases frames at the frame rate on the monotonic clock, like a
+    // camera, and stamps them with their release time.
+    void setRealTime(bool realTime);
+    void setLatencyTracker(const sp<LatencyTracker> &tracker);
+    // Number of threads decompressing a compressed YUV file, see
+    // CompressedYuvReader. 0 means one per CPU.
+    void setDecompressThreads(int numThreads);
 
 protected:
     virtual ~YuvSource();
@@ -24,12 +36,18 @@ protected:
 private:
     MediaBufferGroup mGroup;
     int mWidth, mHeight;
-    int mMaxNumFrames;
-    int mFrameRate;
+    int64_t mMaxNumFrames;
+    float mFrameRate;
     int mColorFormat;
     size_t mSize;
     int64_t mNumFramesOutput;
     FILE* mFile;
+    sp<QualityMonitor> mQualityMonitor;
+    bool mRealTime;
+    nsecs_t mStartTimeNs;
+    sp<LatencyTracker> mLatencyTracker;
+    sp<CompressedYuvReader> mReader;
+    int mDecompressThreads;
 
     YuvSource(const YuvSource &);
     YuvSource &operator=(const YuvSource &);
@@ -14,11 +14,14 @@
  * limitations under the License.
  */
 
+#include <dirent.h>
+#include <errno.h>
 #include <inttypes.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <getopt.h>
+#include <linux/falloc.h>
 
 #include <binder/ProcessState.h>
 #include <media/stagefright/foundation/ADebug.h>
@@ -31,19 +34,28 @@
 #include <media/stagefright/MetaData.h>
 #include <media/stagefright/MPEG4Writer.h>
 #include <media/MediaPlayerInterface.h>
+#include <utils/KeyedVector.h>
+#include <utils/String8.h>
+#include <utils/Vector.h>
 
 #include <OMX_Video.h>
 
 #include "YuvSource.h"
+#include "AvcProbe.h"
 #include "AvcSource.h"
+#include "CompressedYuvReader.h"
+#include "Mp4Source.h"
+#include "LatencyTracker.h"
+#include "QualityMonitor.h"
+#include "SegmentSource.h"
+#include "VideoQuality.h"
 
 using namespace android;
 
-int32_t gNumFramesOutput = 0;
+int64_t gNumFramesOutput = 0;
 
 static const uint32_t kMinBitRate = 100000;         // 0.1Mbps
 static const uint32_t kMaxBitRate = 200 * 1000000;  // 200Mbps
-static const int32_t kMaxTimeLimitSec = 180;       // 3 minutes
 
 float gFrameRate = 30;
 uint32_t gVideoWidth = 176;
@@ -51,15 +63,37 @@ uint32_t gVideoHeight = 144;
 uint32_t gBitRate = 300000;
 int gIFInterval = 1;
 int gColorFormat = OMX_COLOR_FormatYUV420Planar;
-int gFrameLimit = 30000;
+int64_t gFrameLimit = 0;    // unlimited
 int gLevel = -1;        // Encoder specific default
 int gProfile = -1;      // Encoder specific default
 int gOutCodec = 1;
 int gInCodec  = 0;
-int gTimeLimitSec = 60;
+int gTimeLimitSec = 0;      // unlimited
 const char *gOutFileName = "/sdcard/output.mp4";
 const char *gInFileName = NULL;
 bool gPreferSoftwareCodec = false;
+bool gPreallocate = false;
+bool g64BitFileOffset = false;
+int64_t gInterleaveDurationUs = 0;     // MPEG4Writer default
+int64_t gWriteBufferSize = 0;
+int64_t gSegmentDurationUs = 0;
+int64_t gSegmentSize = 0;
+bool gRealTime = false;
+int gIntraRefreshPeriod = 0;
+int gDecompressThreads = 0;    // one per CPU
+int gGopFrames = 0;     // keep every frame
+bool gQuality = false;
+const char *gQualityLogFile = NULL;
+bool gProbe = false;
+
+// Parameter sweep, enabled by any --sweep-* option
+bool gSweep = false;
+int gSweepFrames = 120;
+bool gSweepSoftPrefer = false;
+Vector<uint32_t> gSweepBitRates;
+Vector<int32_t> gSweepProfiles;
+Vector<int32_t> gSweepLevels;
+Vector<int32_t> gSweepIFIntervals;
 
 // Print usage showing how to use this utility to record videos
 static void usage(const char *me) {
@@ -85,25 +119,79 @@ static void usage(const char *me) {
         "    YUV420 color format: [0] semi planar or [1] planar or other omx YUV420 color format\n"
         "    Default is 1\n"
         "--time-limit TIME\n"
-        "    Set the maximum recording time, in seconds.  Default / maximum is %d.\n"
+        "    Set the maximum recording time, in seconds.  Default is %d (unlimited).\n"
         "--frame-limit Frames\n"
-        "    Set the maximum recording frames. Default / maximum is %d.\n"
+        "    Set the maximum recording frames. Default is %" PRId64 " (unlimited).\n"
         "--soft-prefer\n"
         "    Prefer software codec for encode\n"
         "--out-vcodec\n"
         "    Output video codec: [1] AVC [2] M4V [3] H263. Need input video codec YUV. Default is %d.\n"
         "--in-vcodec\n"
-        "    Input video codec: [0] YUV [1] AVC. Default is %d.\n"
+        "    Input video codec: [0] YUV [1] AVC [2] MP4 (remux without decoding). Default is %d.\n"
+        "--keyframes-only\n"
+        "    Keep only the IDR frames of the AVC input. Same as --gop-frames 1.\n"
+        "--gop-frames N\n"
+        "    Keep only the first N frames of every GOP of the AVC input, without\n"
+        "    decoding. Frames keep their timestamps. --time-limit and --frame-limit
+    count input frames.\n"
         "--output FILENAME\n"
         "    Output file. Default is %s\n"
         "--input FILENAME\n"
-        "    Input file for encode and/or package.\n"
+        "    Input file for encode and/or package. A YUV input may be compressed\n"
+        "    frame by frame with LZ4 or Zstandard, see CompressedYuvReader.h.\n"
+        "--decompress-threads N\n"
+        "    Threads decompressing a compressed YUV input. Default is one per CPU.\n"
+        "--realtime\n"
+        "    Release YUV frames at the frame rate on the monotonic clock like a camera,\n"
+        "    configure the encoder for low latency and report capture to mux latency.\n"
+        "--intra-refresh FRAMES\n"
+        "    Refresh the picture with intra macroblocks over FRAMES frames instead\n"
+        "    of sending periodic IDR frames. Need input video codec YUV.\n"
+        "--segment-duration TIME\n"
+        "    Split the output into files of about TIME seconds, named after the\n"
+        "    output file with a -000, -001... suffix. Splits are made at sync frames.\n"
+        "--segment-size SIZE\n"
+        "    Split the output into files of about SIZE bytes, e.g. '2000M' or '5G'.\n"
+        "--preallocate\n"
+        "    Reserve the expected output size on disk before writing, estimated from\n"
+        "    the input size for AVC input or from bit rate x duration for YUV input.\n"
+        "--interleave-ms TIME\n"
+        "    Duration of the chunks written to the output, in milliseconds.\n"
+        "--write-buffer SIZE\n"
+        "    Bytes buffered per written chunk, e.g. '4M'. Converted to a chunk\n"
+        "    duration using the bit rate of the YUV encoder or of the MP4 input.\n"
+        "    Not supported for AVC input. Overrides --interleave-ms.\n"
+        "--64bit-offset\n"
+        "    Use 64-bit chunk offsets, needed for outputs over 4GB. Enabled\n"
+        "    automatically when the expected output size exceeds 4GB.\n"
+        "--quality\n"
+        "    Decode the encoded frames on a worker thread and report Y-PSNR / Y-SSIM\n"
+        "    against the input YUV frames. Need input video codec YUV.\n"
+        "--quality-log FILENAME\n"
+        "    Write per-frame Y-PSNR / Y-SSIM to FILENAME. Implies --quality.\n"
+        "--sweep-bit-rate RATES\n"
+        "    Comma separated bit rates to sweep, e.g. '1M,2M,4M'.\n"
+        "--sweep-profile PROFILES\n"
+        "    Comma separated profiles to sweep, e.g. 'baseline,high'.\n"
+        "--sweep-level LEVELS\n"
+        "    Comma separated levels to sweep, e.g. '3.1,4'.\n"
+        "--sweep-iframe-interval TIMES\n"
+        "    Comma separated i-frame intervals to sweep, e.g. '1,2,5'.\n"
+        "--sweep-soft-prefer\n"
+        "    Sweep both the hardware and the software codec.\n"
+        "--sweep-frames Frames\n"
+        "    Frames encoded per sweep run. Default is %d.\n"
+        "    Any --sweep-* option encodes the YUV input once per parameter set,\n"
+        "    measures fps, output size and Y-PSNR, and prints the Pareto-optimal sets.\n"
+        "--probe\n"
+        "    Scan the AVC input and print NAL unit, slice, GOP, SPS and per-second\n"
+        "    bit rate statistics as JSON to stdout. Nothing is written.\n"
         "--help\n"
         "    Show this message.\n"
         "\n",
         me, gVideoWidth, gVideoHeight, gBitRate, gFrameRate, gIFInterval,
         gProfile, gLevel, gTimeLimitSec, gFrameLimit,
-        gOutCodec, gInCodec, gOutFileName
+        gOutCodec, gInCodec, gOutFileName, gSweepFrames
         );
     exit(1);
 }
@@ -120,10 +208,19 @@ enum {
     kCodecH263 = 3,
 };
 
+// input only, the first AVC video track of an MP4/MOV file
+enum {
+    kCodecMP4 = 2,
+};
+
 static const char* codecName[] = {
     "YUV", "AVC", "M4V", "H264"
 };
 
+static const char* inCodecName[] = {
+    "YUV", "AVC", "MP4"
+};
+
 // returns -1 if mapping of the given color is unsuccessful
 // returns an omx color enum value otherwise
 static int translateColorToOmxEnumValue(int color) {
@@ -196,6 +293,55 @@ static status_t parseValueWithUnit(const char* str, uint32_t* pValue) {
     }
 }
 
+/*
+ * Same as parseValueWithUnit() for 64-bit sizes, also accepting a 'G' unit.
+ *
+ * Returns an error if parsing fails, if the value is negative or if it
+ * overflows.
+ */
+static status_t parseSizeWithUnit(const char* str, int64_t* pValue) {
+    char* endptr;
+    errno = 0;
+    long long value = strtoll(str, &endptr, 10);
+    if (endptr == str || errno == ERANGE || value < 0) {
+        fprintf(stderr, "Invalid value: %s\n", str);
+        return BAD_VALUE;
+    }
+
+    int64_t unit = 1;
+    if (*endptr != '\0') {
+        switch (toupper(*endptr)) {
+            case 'K': unit = 1000; break;
+            case 'M': unit = 1000000; break;
+            case 'G': unit = 1000000000; break;
+            default: unit = 0; break;
+        }
+        if (unit == 0 || *(endptr+1) != '\0') {
+            fprintf(stderr, "Unrecognized value: %s\n", str);
+            return BAD_VALUE;
+        }
+    }
+    if (value > INT64_MAX / unit) {
+        fprintf(stderr, "Value too large: %s\n", str);
+        return BAD_VALUE;
+    }
+    *pValue = value * unit;
+    return NO_ERROR;
+}
+
+static status_t parseProfile(const char* str, int32_t* pValue) {
+    if (strcmp(str, "baseline") == 0)
+        *pValue = OMX_VIDEO_AVCProfileBaseline;
+    else if (strcmp(str, "main") == 0)
+        *pValue = OMX_VIDEO_AVCProfileMain;
+    else if (strcmp(str, "high") == 0)
+        *pValue = OMX_VIDEO_AVCProfileHigh;
+    else
+        return BAD_VALUE;
+
+    return NO_ERROR;
+}
+
 static status_t parseLevel(const char* str, int32_t* pValue) {
     if (strcmp(str, "1") == 0)
         *pValue = OMX_VIDEO_AVCLevel1;
@@ -231,10 +377,596 @@ static status_t parseLevel(const char* str, int32_t* pValue) {
         *pValue = OMX_VIDEO_AVCLevel51;
     else if (strcmp(str, "5.2") == 0)
         *pValue = OMX_VIDEO_AVCLevel52;
+    else
+        return BAD_VALUE;
 
     return NO_ERROR;
 }
 
+/*
+ * Parses a comma separated list, e.g. "1M,2M,4M", calling parse() on each
+ * element.
+ *
+ * Returns an error if any element fails to parse.
+ */
+template<typename T>
+static status_t parseList(const char* str, Vector<T>* pValues,
+        status_t (*parse)(const char*, T*)) {
+    char* copy = strdup(str);
+    char* savePtr = NULL;
+    status_t err = NO_ERROR;
+
+    pValues->clear();
+    for (char* token = strtok_r(copy, ",", &savePtr); token != NULL;
+            token = strtok_r(NULL, ",", &savePtr)) {
+        T value;
+        if (parse(token, &value) != NO_ERROR) {
+            fprintf(stderr, "Unrecognized list element: %s\n", token);
+            err = BAD_VALUE;
+            break;
+        }
+        pValues->push(value);
+    }
+    free(copy);
+    if (err == NO_ERROR && pValues->isEmpty()) {
+        err = BAD_VALUE;
+    }
+    return err;
+}
+
+static status_t parseInt(const char* str, int32_t* pValue) {
+    char* endptr;
+    *pValue = strtol(str, &endptr, 10);
+    return (endptr == str || *endptr != '\0') ? BAD_VALUE : NO_ERROR;
+}
+
+/*
+ * Estimates the output file size from the input file: AVC and MP4 input are
+ * repackaged nearly byte for byte, YUV input is encoded at gBitRate.
+ *
+ * Returns 0 if the input size is unknown.
+ */
+static off64_t estimateOutputSize() {
+    static const off64_t kMoovReserve = 64 * 1024;
+    struct stat64 st;
+    if (stat64(gInFileName, &st) != 0 || st.st_size == 0) {
+        return 0;
+    }
+
+    if (gInCodec != kCodecYUV) {
+        return st.st_size + st.st_size / 100 + kMoovReserve;
+    }
+
+    off64_t numFrames = st.st_size / ((gVideoWidth * gVideoHeight * 3) / 2);
+    if (CompressedYuvReader::isCompressed(gInFileName)) {
+        sp<CompressedYuvReader> reader = new CompressedYuvReader(gInFileName);
+        numFrames = reader->getNumFrames();
+    }
+    if (gFrameLimit > 0 && numFrames > gFrameLimit) {
+        numFrames = gFrameLimit;
+    }
+    // 5% slack for rate control overshoot
+    off64_t size = (off64_t)((gBitRate / 8.0) * (numFrames / gFrameRate) * 1.05);
+    return size + kMoovReserve;
+}
+
+/*
+ * Same as estimateOutputSize(), capped to a single segment.
+ */
+static off64_t estimateSegmentSize() {
+    off64_t size = estimateOutputSize();
+    if (gSegmentSize > 0 && size > (off64_t)gSegmentSize) {
+        size = gSegmentSize + gSegmentSize / 20;
+    }
+    if (gSegmentDurationUs > 0 && gInCodec == kCodecYUV) {
+        off64_t durationSize = (off64_t)((gBitRate / 8.0) * (gSegmentDurationUs / 1E6) * 1.05);
+        if (size > durationSize) {
+            size = durationSize;
+        }
+    }
+    return size;
+}
+
+/*
+ * Returns gOutFileName, or "<name>-<segment>.<ext>" when the output is
+ * split into segments.
+ */
+static String8 segmentFileName(int segment) {
+    String8 name(gOutFileName);
+    if (gSegmentDurationUs == 0 && gSegmentSize == 0) {
+        return name;
+    }
+    String8 segmentName = name.getBasePath();
+    segmentName.appendFormat("-%03d%s", segment, name.getPathExtension().string());
+    return segmentName;
+}
+
+/*
+ * Returns whether the kernel accounts block I/O delays. Delay accounting is
+ * off by default since Linux 5.14 (kernel.task_delayacct) and could be
+ * turned off with the nodelayacct boot option before. When it is off, the
+ * stat field read below stays at 0.
+ */
+static bool isBlockIoDelayAvailable() {
+    FILE* file = fopen("/proc/sys/kernel/task_delayacct", "r");
+    if (file != NULL) {
+        int enabled = 0;
+        bool ok = fscanf(file, "%d", &enabled) == 1;
+        fclose(file);
+        return ok && enabled;
+    }
+
+    char cmdline[4096];
+    file = fopen("/proc/cmdline", "r");
+    if (file == NULL) {
+        return true;
+    }
+    bool ok = fgets(cmdline, sizeof(cmdline), file) != NULL;
+    fclose(file);
+    return !ok || strstr(cmdline, "nodelayacct") == NULL;
+}
+
+// comm of the MPEG4Writer threads, truncated to 15 characters by the kernel
+static const char* kWriterThreadName = "MPEG4Writer";
+static const char* kTrackThreadName = "VideoTrackEncod";
+
+/*
+ * Reads the comm and the block I/O delay ticks (field 42) of a thread of
+ * this process from /proc/self/task/<tid>/stat.
+ *
+ * Returns false if the thread is gone.
+ */
+static bool readBlockIoTicks(pid_t tid, char* comm, size_t commSize, uint64_t* ticks) {
+    char path[64], line[1024];
+    snprintf(path, sizeof(path), "/proc/self/task/%d/stat", tid);
+    FILE* file = fopen(path, "r");
+    if (file == NULL) {
+        return false;
+    }
+    bool ok = fgets(line, sizeof(line), file) != NULL;
+    fclose(file);
+
+    // "pid (comm) state ...", comm may contain spaces and parentheses
+    char* commStart = ok ? strchr(line, '(') : NULL;
+    char* commEnd = ok ? strrchr(line, ')') : NULL;
+    if (commStart == NULL || commEnd == NULL || commEnd < commStart) {
+        return false;
+    }
+    snprintf(comm, commSize, "%.*s", (int)(commEnd - commStart - 1), commStart + 1);
+
+    char* savePtr = NULL;
+    char* token = strtok_r(commEnd + 1, " ", &savePtr);
+    for (int field = 3; token != NULL && field < 42; ++field) {
+        token = strtok_r(NULL, " ", &savePtr);
+    }
+    if (token == NULL) {
+        return false;
+    }
+    *ticks = strtoull(token, NULL, 10);
+    return true;
+}
+
+/*
+ * Returns the block I/O delay accumulated by a thread since the previous
+ * call for the same thread. tickCounts keeps the last value seen per thread.
+ */
+static int64_t updateBlockIoDelayUs(pid_t tid, uint64_t ticks,
+        KeyedVector<pid_t, uint64_t>* tickCounts) {
+    ssize_t index = tickCounts->indexOfKey(tid);
+    if (index < 0) {
+        tickCounts->add(tid, ticks);
+        return 0;
+    }
+    uint64_t deltaTicks = ticks - tickCounts->valueAt(index);
+    tickCounts->replaceValueAt(index, ticks);
+    return deltaTicks * 1000000ll / sysconf(_SC_CLK_TCK);
+}
+
+/*
+ * Returns the block I/O delay accumulated by the MPEG4Writer threads since
+ * the previous call, using the per-task delay accounting. The writer thread
+ * writes the chunks. The track thread only pulls samples from the source,
+ * it is counted when that source does no file I/O (YUV input goes through
+ * the encoder) and left out when it reads the AVC or MP4 input itself, so
+ * that input read stalls are not reported as write stalls. The delay of a
+ * thread since the previous call is lost if it exits in between.
+ */
+static int64_t sampleWriterBlockIoDelayUs(bool includeTrackThread,
+        KeyedVector<pid_t, uint64_t>* tickCounts) {
+    DIR* dir = opendir("/proc/self/task");
+    if (dir == NULL) {
+        return 0;
+    }
+
+    int64_t delayUs = 0;
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] == '.') {
+            continue;
+        }
+        pid_t tid = atoi(entry->d_name);
+        char comm[32];
+        uint64_t ticks;
+        if (!readBlockIoTicks(tid, comm, sizeof(comm), &ticks)) {
+            continue;
+        }
+        if (strcmp(comm, kWriterThreadName) == 0
+                || (includeTrackThread && strcmp(comm, kTrackThreadName) == 0)) {
+            delayUs += updateBlockIoDelayUs(tid, ticks, tickCounts);
+        }
+    }
+    closedir(dir);
+    return delayUs;
+}
+
+/*
+ * Returns the block I/O delay accumulated by the calling thread since the
+ * previous call, MPEG4Writer::stop() writes the moov box on it.
+ */
+static int64_t sampleCallerBlockIoDelayUs(KeyedVector<pid_t, uint64_t>* tickCounts) {
+    pid_t tid = gettid();
+    char comm[32];
+    uint64_t ticks;
+    if (!readBlockIoTicks(tid, comm, sizeof(comm), &ticks)) {
+        return 0;
+    }
+    return updateBlockIoDelayUs(tid, ticks, tickCounts);
+}
+
+/*
+ * Stops the pipeline after an error, also between two segments, so that the
+ * encoder and its source are stopped and the quality monitor sees the end of
+ * the stream.
+ */
+static void stopPipeline(const sp<SegmentSource>& segmenter, const sp<QualityMonitor>& monitor) {
+    segmenter->forceStop();
+    if (monitor != NULL) {
+        monitor->stop();
+    }
+}
+
+/*
+ * Builds the source / encoder / writer pipeline from the global settings,
+ * packages the whole input into gOutFileName (or one file per segment) and
+ * waits for completion.
+ *
+ * MP4 input is read from mp4Source, opened beforehand to get the size of
+ * the track. Returns the wall clock time spent in *elapsedNs. If
+ * qualityMonitor is not NULL and --quality is set, it receives the monitor
+ * once it has finished. Likewise latencyTracker receives the latency
+ * measurements of --realtime.
+ */
+static status_t packageVideo(const sp<Mp4Source>& mp4Source, int64_t* elapsedNs,
+        sp<QualityMonitor>* qualityMonitor, sp<LatencyTracker>* latencyTracker) {
+    sp<IMediaSource> encoder;
+    sp<MediaSource> source;
+    sp<ALooper> looper;
+    sp<MediaCodecSource> codecSource;
+    sp<QualityMonitor> monitor;
+    sp<LatencyTracker> tracker;
+    // bit rate of the output, 0 if unknown as for AVC input
+    int32_t bitRate = gInCodec == kCodecYUV ? gBitRate : 0;
+    int64_t durationUs = 0;
+    if (gInCodec == kCodecYUV) {
+        // input video format is YUV, require encoder
+        sp<YuvSource> yuvSource = new YuvSource(gVideoWidth, gVideoHeight, gFrameLimit, gFrameRate, gColorFormat, gInFileName);
+        source = yuvSource;
+        yuvSource->setDecompressThreads(gDecompressThreads);
+        sp<AMessage> enc_meta = new AMessage;
+        switch (gOutCodec) {
+            case kCodecM4V:
+                enc_meta->setString("mime", MEDIA_MIMETYPE_VIDEO_MPEG4);
+                break;
+            case kCodecH263:
+                enc_meta->setString("mime", MEDIA_MIMETYPE_VIDEO_H263);
+                break;
+            default:
+                enc_meta->setString("mime", MEDIA_MIMETYPE_VIDEO_AVC);
+                break;
+        }
+        enc_meta->setInt32("width", gVideoWidth);
+        enc_meta->setInt32("height", gVideoHeight);
+        enc_meta->setInt32("frame-rate", gFrameRate);
+        enc_meta->setInt32("bitrate", gBitRate);
+        enc_meta->setInt32("stride", gVideoWidth);
+        enc_meta->setInt32("slice-height", gVideoHeight);
+        enc_meta->setInt32("i-frame-interval", gIFInterval);
+        enc_meta->setInt32("color-format", gColorFormat);
+        if (gLevel != -1) {
+            enc_meta->setInt32("level", gLevel);
+        }
+        if (gProfile != -1) {
+            enc_meta->setInt32("profile", gProfile);
+        }
+        if (gRealTime) {
+            yuvSource->setRealTime(true);
+            if (latencyTracker != NULL) {
+                tracker = new LatencyTracker;
+                yuvSource->setLatencyTracker(tracker);
+            }
+
+            // no B frames nor lookahead, output each frame as soon as possible
+            if (gProfile == -1 && gOutCodec == kCodecAVC) {
+                enc_meta->setInt32("profile", OMX_VIDEO_AVCProfileBaseline);
+            }
+            enc_meta->setInt32("max-bframes", 0);
+            enc_meta->setInt32("latency", 1);
+            enc_meta->setInt32("priority", 0);  // realtime
+        }
+        if (gIntraRefreshPeriod > 0) {
+            enc_meta->setInt32("intra-refresh-period", gIntraRefreshPeriod);
+            enc_meta->setInt32("i-frame-interval", -1);  // first frame only
+        }
+
+        looper = new ALooper;
+        looper->setName("packagevideo");
+        looper->start();
+
+        encoder = codecSource = MediaCodecSource::Create(
+                    looper, enc_meta, source, NULL /* consumer */,
+                    gPreferSoftwareCodec ? MediaCodecSource::FLAG_PREFER_SOFTWARE_CODEC : 0);
+        if (encoder == NULL) {
+            fprintf(stderr, "couldn't create encoder\n");
+            return UNKNOWN_ERROR;
+        }
+
+        if (gQuality && qualityMonitor != NULL) {
+            monitor = new QualityMonitor(gVideoWidth, gVideoHeight, gQualityLogFile);
+            yuvSource->setQualityMonitor(monitor);
+            encoder = monitor->tap(encoder);
+            if (monitor->start() != OK) {
+                fprintf(stderr, "couldn't start quality monitor\n");
+                return UNKNOWN_ERROR;
+            }
+        }
+    } else if (gInCodec == kCodecAVC) {
+        // input video format is AVC, no encoder required
+        sp<AvcSource> avcSource = new AvcSource(gVideoWidth, gVideoHeight, gFrameLimit, gFrameRate, gColorFormat, gInFileName);
+        avcSource->setGopFrames(gGopFrames);
+        encoder = source = avcSource;
+    } else if (gInCodec == kCodecMP4) {
+        // input is an MP4/MOV file, copy its AVC samples and timestamps
+        CHECK(mp4Source != NULL);
+        // the samples have real timestamps, no need to count frames
+        mp4Source->setTimeLimitUs(gTimeLimitSec * 1000000ll);
+        encoder = source = mp4Source;
+        bitRate = mp4Source->getBitRate();
+        durationUs = mp4Source->getDurationUs();
+    }
+
+    if (gWriteBufferSize > 0 && bitRate <= 0) {
+        fprintf(stderr, "--write-buffer needs a known bit rate, use --interleave-ms\n");
+        if (monitor != NULL) {
+            monitor->stop();
+        }
+        return BAD_VALUE;
+    }
+
+    sp<SegmentSource> segmenter = new SegmentSource(encoder, gSegmentDurationUs, gSegmentSize);
+    if (codecSource != NULL) {
+        segmenter->setEncoder(codecSource);
+    }
+    segmenter->setLatencyTracker(tracker);
+
+    // the track thread reads the AVC and MP4 input files itself
+    bool sampleTrackThread = gInCodec == kCodecYUV;
+    KeyedVector<pid_t, uint64_t> tickCounts;
+    sampleCallerBlockIoDelayUs(&tickCounts);
+    int64_t blockIoDelayUs = 0;
+    int64_t finalizeBlockIoDelayUs = 0;
+    int64_t finalizeNs = 0;
+    off64_t totalSize = 0;
+    bool lastSegment = false;
+    status_t err = OK;
+
+    int64_t start = systemTime();
+    for (int segment = 0; !lastSegment; ++segment) {
+        String8 fileName = segmentFileName(segment);
+        int fd = open(fileName.string(), O_CREAT | O_LARGEFILE | O_TRUNC | O_RDWR, S_IRUSR | S_IWUSR);
+        if (fd < 0) {
+            fprintf(stderr, "couldn't open file");
+            stopPipeline(segmenter, monitor);
+            return UNKNOWN_ERROR;
+        }
+
+        off64_t expectedSize = estimateSegmentSize();
+        if (gPreallocate && expectedSize > 0) {
+            // Keep the file size so that nothing but the written data is visible.
+            if (fallocate64(fd, FALLOC_FL_KEEP_SIZE, 0, expectedSize) != 0) {
+                fprintf(stderr, "couldn't preallocate %" PRId64 " bytes: %s\n",
+                        (int64_t)expectedSize, strerror(errno));
+            }
+        }
+
+        sp<MPEG4Writer> writer = new MPEG4Writer(fd);
+        writer->addSource(segmenter);
+        if (gWriteBufferSize > 0) {
+            // computed in floating point, a large size would overflow 64 bits
+            double interleaveUs = gWriteBufferSize * 8E6 / bitRate;
+            writer->setInterleaveDuration(
+                    interleaveUs > UINT32_MAX ? UINT32_MAX : (uint32_t)interleaveUs);
+        } else if (gInterleaveDurationUs > 0) {
+            writer->setInterleaveDuration((uint32_t)gInterleaveDurationUs);
+        }
+
+        sp<MetaData> params = new MetaData;
+        if (bitRate > 0) {
+            params->setInt32(kKeyBitRate, bitRate);
+        }
+        if (durationUs > 0 && gSegmentDurationUs == 0 && gSegmentSize == 0) {
+            // The writer sizes the space reserved for the moov box at the
+            // front of the file from the expected duration and bit rate.
+            writer->setMaxFileDuration(durationUs + 1000000ll);
+        }
+        if (g64BitFileOffset || expectedSize > (off64_t)UINT32_MAX) {
+            params->setInt32(kKey64BitFileOffset, true);
+        }
+
+        CHECK_EQ((status_t)OK, writer->start(params.get()));
+        while (!writer->reachedEOS()) {
+            usleep(100000);
+            blockIoDelayUs += sampleWriterBlockIoDelayUs(sampleTrackThread, &tickCounts);
+        }
+        lastSegment = !segmenter->hasNextSegment();
+        if (lastSegment) {
+            source->stop();
+        }
+        // The track and writer threads exit in stop(), sample them before.
+        // The moov box is written by this thread, which is sampled after.
+        blockIoDelayUs += sampleWriterBlockIoDelayUs(sampleTrackThread, &tickCounts);
+        sampleCallerBlockIoDelayUs(&tickCounts);
+        int64_t stopStart = systemTime();
+        err = writer->stop();
+        finalizeNs += systemTime() - stopStart;
+        finalizeBlockIoDelayUs += sampleCallerBlockIoDelayUs(&tickCounts);
+
+        struct stat64 st;
+        if (fstat64(fd, &st) == 0) {
+            if (gPreallocate) {
+                // release the blocks reserved past the end of the file
+                if (ftruncate64(fd, st.st_size) != 0) {
+                    fprintf(stderr, "couldn't trim preallocation: %s\n", strerror(errno));
+                }
+            }
+            totalSize += st.st_size;
+            if (!lastSegment || segment > 0) {
+                fprintf(stderr, "\nsegment %s: %" PRId64 " bytes\n",
+                        fileName.string(), (int64_t)st.st_size);
+            }
+        }
+        close(fd);
+
+        if (err != OK && err != ERROR_END_OF_STREAM) {
+            stopPipeline(segmenter, monitor);
+            break;
+        }
+    }
+    int64_t end = systemTime();
+
+    fprintf(stderr, "$\n");
+
+    fprintf(stderr, "wrote %" PRId64 " bytes (expected %" PRId64 "), finalize %" PRId64 " us, ",
+            (int64_t)totalSize, (int64_t)estimateOutputSize(), finalizeNs / 1000);
+    if (isBlockIoDelayAvailable()) {
+        fprintf(stderr, "writer block I/O delay %" PRId64 " us writing, %" PRId64
+                " us finalizing\n",
+                blockIoDelayUs, finalizeBlockIoDelayUs);
+    } else {
+        fprintf(stderr, "block I/O delay unavailable (delay accounting is off)\n");
+    }
+
+    if (monitor != NULL) {
+        monitor->waitForCompletion();
+        *qualityMonitor = monitor;
+    }
+    if (tracker != NULL) {
+        *latencyTracker = tracker;
+    }
+    *elapsedNs = end - start;
+    return err;
+}
+
+struct SweepResult {
+    uint32_t bitRate;
+    int32_t profile;
+    int32_t level;
+    int32_t iFInterval;
+    bool preferSoftwareCodec;
+    status_t err;
+    double fps;
+    off64_t size;
+    double psnr;
+};
+
+// a dominates b if it is no worse in fps, size and PSNR and better in one
+static bool dominates(const SweepResult& a, const SweepResult& b) {
+    if (a.fps < b.fps || a.size > b.size || a.psnr < b.psnr) {
+        return false;
+    }
+    return a.fps > b.fps || a.size < b.size || a.psnr > b.psnr;
+}
+
+/*
+ * Encodes the first gSweepFrames frames of the YUV input once for every
+ * combination of the --sweep-* lists, then prints every result and marks
+ * the Pareto-optimal ones with '*'.
+ */
+static int runSweep() {
+    if (gInCodec != kCodecYUV) {
+        fprintf(stderr, "Parameter sweep needs input video codec YUV\n");
+        return 2;
+    }
+    if (CompressedYuvReader::isCompressed(gInFileName)) {
+        // measureFilePsnr() reads the reference frames from the input file
+        fprintf(stderr, "Parameter sweep needs an uncompressed YUV input\n");
+        return 2;
+    }
+    if (gQuality || gRealTime) {
+        // every run is measured against the input file afterwards instead
+        fprintf(stderr, "Parameter sweep can't be combined with --quality or --realtime\n");
+        return 2;
+    }
+    if (gSweepBitRates.isEmpty()) gSweepBitRates.push(gBitRate);
+    if (gSweepProfiles.isEmpty()) gSweepProfiles.push(gProfile);
+    if (gSweepLevels.isEmpty()) gSweepLevels.push(gLevel);
+    if (gSweepIFIntervals.isEmpty()) gSweepIFIntervals.push(gIFInterval);
+    if (gFrameLimit == 0 || gFrameLimit > gSweepFrames) gFrameLimit = gSweepFrames;
+    // every run is measured from gOutFileName
+    gSegmentDurationUs = 0;
+    gSegmentSize = 0;
+
+    Vector<SweepResult> results;
+    for (size_t b = 0; b < gSweepBitRates.size(); ++b)
+    for (size_t p = 0; p < gSweepProfiles.size(); ++p)
+    for (size_t l = 0; l < gSweepLevels.size(); ++l)
+    for (size_t i = 0; i < gSweepIFIntervals.size(); ++i)
+    for (int soft = gSweepSoftPrefer ? 0 : gPreferSoftwareCodec;
+            soft <= (gSweepSoftPrefer ? 1 : gPreferSoftwareCodec); ++soft) {
+        SweepResult r;
+        memset(&r, 0, sizeof(r));
+        gBitRate = r.bitRate = gSweepBitRates[b];
+        gProfile = r.profile = gSweepProfiles[p];
+        gLevel = r.level = gSweepLevels[l];
+        gIFInterval = r.iFInterval = gSweepIFIntervals[i];
+        gPreferSoftwareCodec = r.preferSoftwareCodec = soft;
+
+        fprintf(stderr, "sweep: bit rate %u profile %d level %d i-frame %d%s\n",
+                r.bitRate, r.profile, r.level, r.iFInterval,
+                r.preferSoftwareCodec ? " soft" : "");
+        int64_t elapsedNs = 0;
+        r.err = packageVideo(NULL, &elapsedNs, NULL, NULL);
+        if (r.err == OK || r.err == ERROR_END_OF_STREAM) {
+            struct stat st;
+            int64_t numFrames;
+            r.fps = elapsedNs > 0 ? (gNumFramesOutput * 1E9) / elapsedNs : 0;
+            r.size = stat(gOutFileName, &st) == 0 ? st.st_size : 0;
+            r.err = measureFilePsnr(gOutFileName, gInFileName,
+                    gVideoWidth, gVideoHeight, gFrameRate, gSweepFrames, &r.psnr, &numFrames);
+        }
+        results.push(r);
+    }
+
+    printf("\n%10s %8s %6s %8s %5s %9s %12s %8s\n", "bitrate", "profile",
+            "level", "iframe", "soft", "fps", "bytes", "psnr");
+    for (size_t i = 0; i < results.size(); ++i) {
+        const SweepResult& r = results[i];
+        bool optimal = r.err == OK;
+        for (size_t j = 0; optimal && j < results.size(); ++j) {
+            optimal = results[j].err != OK || !dominates(results[j], r);
+        }
+        if (r.err != OK) {
+            printf("%10u %8d %6d %8d %5d   failed: %d\n", r.bitRate, r.profile,
+                    r.level, r.iFInterval, r.preferSoftwareCodec, r.err);
+            continue;
+        }
+        printf("%10u %8d %6d %8d %5d %9.2f %12" PRId64 " %8.2f%s\n", r.bitRate,
+                r.profile, r.level, r.iFInterval, r.preferSoftwareCodec,
+                r.fps, (int64_t)r.size, r.psnr, optimal ? " *" : "");
+    }
+    printf("* Pareto-optimal in fps, size and Y-PSNR\n");
+    return 0;
+}
+
 int main(int argc, char **argv) {
     static const struct option longOptions[] = {
         { "help",               no_argument,        NULL, 'h' },
@@ -250,8 +982,28 @@ int main(int argc, char **argv) {
         { "soft-prefer",        no_argument,        NULL, 'q' },
         { "out-vcodec",         required_argument,  NULL, 'w' },
         { "in-vcodec",          required_argument,  NULL, 'x' },
+        { "keyframes-only",     no_argument,        NULL, 'K' },
+        { "gop-frames",         required_argument,  NULL, 'G' },
         { "output",             required_argument,  NULL, 'o' },
         { "input",              required_argument,  NULL, 'i' },
+        { "decompress-threads", required_argument,  NULL, 'k' },
+        { "realtime",           no_argument,        NULL, 'R' },
+        { "intra-refresh",      required_argument,  NULL, 'r' },
+        { "segment-duration",   required_argument,  NULL, 'd' },
+        { "segment-size",       required_argument,  NULL, 'z' },
+        { "preallocate",        no_argument,        NULL, 'f' },
+        { "interleave-ms",      required_argument,  NULL, 'I' },
+        { "write-buffer",       required_argument,  NULL, 'W' },
+        { "64bit-offset",       no_argument,        NULL, 'O' },
+        { "quality",            no_argument,        NULL, 'm' },
+        { "quality-log",        required_argument,  NULL, 'M' },
+        { "sweep-bit-rate",     required_argument,  NULL, 'B' },
+        { "sweep-profile",      required_argument,  NULL, 'P' },
+        { "sweep-level",        required_argument,  NULL, 'L' },
+        { "sweep-iframe-interval", required_argument, NULL, 'E' },
+        { "sweep-soft-prefer",  no_argument,        NULL, 'Q' },
+        { "sweep-frames",       required_argument,  NULL, 'N' },
+        { "probe",              no_argument,        NULL, 'j' },
         { NULL,                 0,                  NULL, 0 }
     };
 
@@ -294,10 +1046,8 @@ int main(int argc, char **argv) {
             break;
         case 't':
             gTimeLimitSec = atoi(optarg);
-            if (gTimeLimitSec == 0 || gTimeLimitSec > kMaxTimeLimitSec) {
-                fprintf(stderr,
-                        "Time limit %ds outside acceptable range [1,%d]\n",
-                        gTimeLimitSec, kMaxTimeLimitSec);
+            if (gTimeLimitSec < 0) {
+                fprintf(stderr, "Invalid time limit %ds\n", gTimeLimitSec);
                 return 2;
             }
             break;
@@ -308,13 +1058,7 @@ int main(int argc, char **argv) {
             gIFInterval = atoi(optarg);
             break;
         case 'p':// -p main
-            if (strcmp(optarg, "baseline") == 0) {
-                gProfile = OMX_VIDEO_AVCProfileBaseline;
-            } else if (strcmp(optarg, "main") == 0) {
-                gProfile = OMX_VIDEO_AVCProfileMain;
-            } else if (strcmp(optarg, "high") == 0) {
-                gProfile = OMX_VIDEO_AVCProfileHigh;
-            }
+            parseProfile(optarg, &gProfile);
             break;
         case 'l':// -l 5.1
             parseLevel(optarg, &gLevel);
@@ -326,7 +1070,11 @@ int main(int argc, char **argv) {
             }
             break;
         case 'n':
-            gFrameLimit = atoi(optarg);
+            gFrameLimit = strtoll(optarg, NULL, 10);
+            if (gFrameLimit < 0) {
+                fprintf(stderr, "Invalid frame limit %" PRId64 "\n", gFrameLimit);
+                return 2;
+            }
             break;
         case 'q':
             gPreferSoftwareCodec = true;
@@ -339,16 +1087,127 @@ int main(int argc, char **argv) {
             break;
         case 'x':
             gInCodec = atoi(optarg);
-            if (gInCodec < 0 || gInCodec > 1) {
+            if (gInCodec < 0 || gInCodec > kCodecMP4) {
                 usage(argv[0]);
             }
             break;
+        case 'K':
+            gGopFrames = 1;
+            break;
+        case 'G':
+            gGopFrames = atoi(optarg);
+            if (gGopFrames <= 0) {
+                fprintf(stderr, "Invalid GOP frames %s\n", optarg);
+                return 2;
+            }
+            break;
         case 'o':
             gOutFileName = optarg;
             break;
         case 'i':
             gInFileName = optarg;
             break;
+        case 'k':
+            gDecompressThreads = atoi(optarg);
+            if (gDecompressThreads <= 0) {
+                fprintf(stderr, "Invalid decompress threads %s\n", optarg);
+                return 2;
+            }
+            break;
+        case 'R':
+            gRealTime = true;
+            break;
+        case 'r':
+            gIntraRefreshPeriod = atoi(optarg);
+            if (gIntraRefreshPeriod <= 0) {
+                fprintf(stderr, "Invalid intra refresh period %s\n", optarg);
+                return 2;
+            }
+            break;
+        case 'd':
+            gSegmentDurationUs = atoi(optarg) * 1000000ll;
+            if (gSegmentDurationUs <= 0) {
+                fprintf(stderr, "Invalid segment duration %s\n", optarg);
+                return 2;
+            }
+            break;
+        case 'z':
+            if (parseSizeWithUnit(optarg, &gSegmentSize) != NO_ERROR) {
+                return 2;
+            }
+            break;
+        case 'f':
+            gPreallocate = true;
+            break;
+        case 'I':
+            gInterleaveDurationUs = atoi(optarg) * 1000ll;
+            if (gInterleaveDurationUs <= 0) {
+                fprintf(stderr, "Invalid interleave duration %s\n", optarg);
+                return 2;
+            }
+            break;
+        case 'W':
+            if (parseSizeWithUnit(optarg, &gWriteBufferSize) != NO_ERROR) {
+                return 2;
+            }
+            break;
+        case 'O':
+            g64BitFileOffset = true;
+            break;
+        case 'm':
+            gQuality = true;
+            break;
+        case 'M':
+            gQuality = true;
+            gQualityLogFile = optarg;
+            break;
+        case 'B':
+            if (parseList(optarg, &gSweepBitRates, parseValueWithUnit) != NO_ERROR) {
+                return 2;
+            }
+            for (size_t i = 0; i < gSweepBitRates.size(); ++i) {
+                if (gSweepBitRates[i] < kMinBitRate || gSweepBitRates[i] > kMaxBitRate) {
+                    fprintf(stderr,
+                            "Bit rate %dbps outside acceptable range [%d,%d]\n",
+                            gSweepBitRates[i], kMinBitRate, kMaxBitRate);
+                    return 2;
+                }
+            }
+            gSweep = true;
+            break;
+        case 'P':
+            if (parseList(optarg, &gSweepProfiles, parseProfile) != NO_ERROR) {
+                return 2;
+            }
+            gSweep = true;
+            break;
+        case 'L':
+            if (parseList(optarg, &gSweepLevels, parseLevel) != NO_ERROR) {
+                return 2;
+            }
+            gSweep = true;
+            break;
+        case 'E':
+            if (parseList(optarg, &gSweepIFIntervals, parseInt) != NO_ERROR) {
+                return 2;
+            }
+            gSweep = true;
+            break;
+        case 'Q':
+            gSweepSoftPrefer = true;
+            gSweep = true;
+            break;
+        case 'N':
+            gSweepFrames = atoi(optarg);
+            if (gSweepFrames <= 0) {
+                fprintf(stderr, "Invalid sweep frames %d\n", gSweepFrames);
+                return 2;
+            }
+            gSweep = true;
+            break;
+        case 'j':
+            gProbe = true;
+            break;
         default:
             if (ic != '?') {
                 fprintf(stderr, "getopt_long returned unexpected value 0x%x\n", ic);
@@ -362,15 +1221,35 @@ int main(int argc, char **argv) {
         return 3;
     }
 
+    if (gProbe) {
+        if (gInCodec != kCodecAVC) {
+            fprintf(stderr, "Probe needs input video codec AVC\n");
+            return 2;
+        }
+        return probeAvcFile(gInFileName, gFrameRate, stdout) == OK ? 0 : 1;
+    }
+
+    sp<Mp4Source> mp4Source;
+    if (gInCodec == kCodecMP4) {
+        // --size is not needed, take it from the track
+        mp4Source = new Mp4Source(gFrameLimit, gInFileName);
+        if (mp4Source->initCheck() != OK) {
+            return 1;
+        }
+        gVideoWidth = mp4Source->getWidth();
+        gVideoHeight = mp4Source->getHeight();
+    }
+
         printf("Input\n");
         printf("\tFilename: %s\n", gInFileName);
         printf("\tSize: %dx%d\n", gVideoWidth, gVideoHeight);
-        printf("\tInput video codec: %s\n", codecName[gInCodec]);
+        printf("\tInput video codec: %s\n", inCodecName[gInCodec]);
         printf("\n");
         printf("Output\n");
         printf("\tFilename: %s\n", gOutFileName);
         printf("\tOutput video codec: %s\n", codecName[gOutCodec]);
         printf("\tColor format: %d\n", gColorFormat);
+        if (gGopFrames > 0) printf("\tGOP frames: %d\n", gGopFrames);
         if (gInCodec == kCodecYUV) {
             printf("\tBit rate: %d\n", gBitRate);
             printf("\tFrame rate: %.1f\n", gFrameRate);
@@ -378,77 +1257,53 @@ int main(int argc, char **argv) {
             printf("\tProfile: %d\n", gProfile);
             printf("\tLevel: %d\n", gLevel);
             if (gPreferSoftwareCodec) printf("\tPrefer software codec\n");
+            if (gRealTime) printf("\tReal time, low latency\n");
+            if (gIntraRefreshPeriod > 0) printf("\tIntra refresh period: %d frames\n", gIntraRefreshPeriod);
         }
 
-    status_t err = OK;
-    sp<IMediaSource> encoder;
-    sp<MediaSource> source;
-    if (gInCodec == kCodecYUV) {
-        // input video format is YUV, require encoder
-        source = new YuvSource(gVideoWidth, gVideoHeight, gFrameLimit, gFrameRate, gColorFormat, gInFileName);
-        sp<AMessage> enc_meta = new AMessage;
-        switch (gOutCodec) {
-            case kCodecM4V:
-                enc_meta->setString("mime", MEDIA_MIMETYPE_VIDEO_MPEG4);
-                break;
-            case kCodecH263:
-                enc_meta->setString("mime", MEDIA_MIMETYPE_VIDEO_H263);
-                break;
-            default:
-                enc_meta->setString("mime", MEDIA_MIMETYPE_VIDEO_AVC);
-                break;
-        }
-        enc_meta->setInt32("width", gVideoWidth);
-        enc_meta->setInt32("height", gVideoHeight);
-        enc_meta->setInt32("frame-rate", gFrameRate);
-        enc_meta->setInt32("bitrate", gBitRate);
-        enc_meta->setInt32("stride", gVideoWidth);
-        enc_meta->setInt32("slice-height", gVideoHeight);
-        enc_meta->setInt32("i-frame-interval", gIFInterval);
-        enc_meta->setInt32("color-format", gColorFormat);
-        if (gLevel != -1) {
-            enc_meta->setInt32("level", gLevel);
-        }
-        if (gProfile != -1) {
-            enc_meta->setInt32("profile", gProfile);
+    // MP4 input is limited by the timestamps of its samples instead
+    if (gTimeLimitSec > 0 && gInCodec != kCodecMP4) {
+        int64_t timeLimitFrames = (int64_t)(gTimeLimitSec * gFrameRate);
+        if (gFrameLimit == 0 || timeLimitFrames < gFrameLimit) {
+            gFrameLimit = timeLimitFrames;
         }
+    }
 
-        sp<ALooper> looper = new ALooper;
-        looper->setName("packagevideo");
-        looper->start();
+    if (gSweep) {
+        return runSweep();
+    }
 
-        encoder = MediaCodecSource::Create(
-                    looper, enc_meta, source, NULL /* consumer */,
-                    gPreferSoftwareCodec ? MediaCodecSource::FLAG_PREFER_SOFTWARE_CODEC : 0);
-    } else if (gInCodec == kCodecAVC) {
-        // input video format is AVC, no encoder required
-        encoder = source = new AvcSource(gVideoWidth, gVideoHeight, gFrameLimit, gFrameRate, gColorFormat, gInFileName);
+    if (gIntraRefreshPeriod > 0 && gInCodec != kCodecYUV) {
+        fprintf(stderr, "Intra refresh needs input video codec YUV\n");
+        return 2;
     }
 
-    int fd = open(gOutFileName, O_CREAT | O_LARGEFILE | O_TRUNC | O_RDWR, S_IRUSR | S_IWUSR);
-    if (fd < 0) {
-        fprintf(stderr, "couldn't open file");
-        return 1;
+    if (gGopFrames > 0 && gInCodec != kCodecAVC) {
+        fprintf(stderr, "GOP trimming needs input video codec AVC\n");
+        return 2;
     }
-    sp<MPEG4Writer> writer = new MPEG4Writer(fd);
-    close(fd);
-    writer->addSource(encoder);
-    int64_t start = systemTime();
-    CHECK_EQ((status_t)OK, writer->start());
-    while (!writer->reachedEOS()) {
-        usleep(100000);
+
+    if (gQuality && gInCodec != kCodecYUV) {
+        fprintf(stderr, "Quality measurement needs input video codec YUV\n");
+        return 2;
     }
-    source->stop();
-    err = writer->stop();
-    int64_t end = systemTime();
 
-    fprintf(stderr, "$\n");
+    int64_t elapsedNs = 0;
+    sp<QualityMonitor> qualityMonitor;
+    sp<LatencyTracker> latencyTracker;
+    status_t err = packageVideo(mp4Source, &elapsedNs, &qualityMonitor, &latencyTracker);
 
     if (err != OK && err != ERROR_END_OF_STREAM) {
         fprintf(stderr, "record failed: %d\n", err);
         return 1;
     }
-    fprintf(stderr, "encoding %d frames in %" PRId64 " us\n", gNumFramesOutput, (end-start)/1000);
-    fprintf(stderr, "encoding speed is: %.2f fps\n", (gNumFramesOutput * 1E9) / (end-start));
+    fprintf(stderr, "encoding %" PRId64 " frames in %" PRId64 " us\n", gNumFramesOutput, elapsedNs/1000);
+    fprintf(stderr, "encoding speed is: %.2f fps\n", (gNumFramesOutput * 1E9) / elapsedNs);
+    if (qualityMonitor != NULL) {
+        qualityMonitor->dumpStats(stderr);
+    }
+    if (latencyTracker != NULL) {
+        latencyTracker->dumpStats(stderr);
+    }
     return 0;
 }